@@ -0,0 +1,75 @@
+/* common.c - Helpers shared by the benchmarks */
+#define _POSIX_C_SOURCE 200809L
+
+#include "common.h"
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DOC_CHUNK (1 << 20)
+
+/* One period of every generated document */
+static const char doc_text[] =
+    "/* generated benchmark document */\n"
+    "#include <stdio.h>\n"
+    "\n"
+    "static int compute(int a, int b) {\n"
+    "    int result = 0;\n"
+    "    for (int i = 0; i < a; i++) {\n"
+    "        if (i % 3 == 0) result += b; // every third\n"
+    "        else result -= i;\n"
+    "    }\n"
+    "    printf(\"result: %d\\n\", result);\n"
+    "    return result;\n"
+    "}\n"
+    "\n";
+
+double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+size_t parse_size(const char *s, char **end) {
+    size_t n = strtoull(s, end, 10);
+    switch (**end) {
+        case 'K': case 'k': n <<= 10; (*end)++; break;
+        case 'M': case 'm': n <<= 20; (*end)++; break;
+        case 'G': case 'g': n <<= 30; (*end)++; break;
+    }
+    return n;
+}
+
+void doc_fill(char *buf, size_t len, size_t *off) {
+    size_t period = sizeof(doc_text) - 1;
+    while (len > 0) {
+        size_t at = *off % period;
+        size_t n = period - at < len ? period - at : len;
+        memcpy(buf, doc_text + at, n);
+        buf += n;
+        len -= n;
+        *off += n;
+    }
+}
+
+int make_document(const char *path, size_t size) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if (fd == -1) return -1;
+    
+    char *buf = malloc(DOC_CHUNK);
+    size_t off = 0;
+    while (off < size) {
+        size_t len = size - off < DOC_CHUNK ? size - off : DOC_CHUNK;
+        doc_fill(buf, len, &off);
+        if (write(fd, buf, len) != (ssize_t)len) {
+            free(buf);
+            close(fd);
+            unlink(path);
+            return -1;
+        }
+    }
+    free(buf);
+    return close(fd);
+}
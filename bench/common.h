@@ -0,0 +1,20 @@
+/* common.h - Helpers shared by the benchmarks */
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#include <stddef.h>
+
+/* Monotonic clock in microseconds */
+double now_us(void);
+
+/* Parse "64K", "16M", "1G" or a plain byte count */
+size_t parse_size(const char *s, char **end);
+
+/* Fill buf with len bytes of generated C source. *off is the position
+ * in the generated text, so successive calls continue one document. */
+void doc_fill(char *buf, size_t len, size_t *off);
+
+/* Write a generated document of size bytes to a new file at path */
+int make_document(const char *path, size_t size);
+
+#endif /* BENCH_COMMON_H */
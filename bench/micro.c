@@ -0,0 +1,414 @@
+/* micro.c - Microbenchmarks for buffer, history, highlighting, search, regex, grep and rendering */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "buffer.h"
+#include "history.h"
+#include "selection.h"
+#include "syntax.h"
+#include "lang.h"
+#include "display.h"
+#include "editor.h"
+#include "search.h"
+#include "regex.h"
+#include "grep.h"
+#include "common.h"
+
+#define DEFAULT_SIZES "64K,1M,16M"
+#define DEFAULT_THRESHOLD 10.0
+/* Each measurement runs at least this long; the best of ROUNDS is kept */
+#define MIN_RUN_US 50000.0
+#define ROUNDS 3
+#define SCREEN_ROWS 50
+#define SCREEN_COLS 160
+
+/* A synthetic document, loaded both into a gap buffer of its own and
+ * into the editor, which highlights it with the C language */
+struct doc {
+    size_t size;
+    char *text;
+    struct gapbuf g;
+    size_t rows;
+    const struct language *lang;
+    const char *path;   /* the document on disk */
+};
+
+/* Performs n operations of a benchmark on d */
+typedef void (*benchFn)(struct doc *d, long n);
+
+struct bench {
+    const char *name;
+    benchFn run;
+    int per_byte;       /* an operation covers the whole document */
+};
+
+/* Cheap deterministic sequence for positions */
+static unsigned long rng = 1;
+
+static unsigned long next_rand(void) {
+    rng = rng * 6364136223846793005UL + 1442695040888963407UL;
+    return rng >> 33;
+}
+
+/* -------- benchmarks -------- */
+static void move_by(struct doc *d, long n, size_t dist) {
+    size_t from = (d->size - dist) / 2;
+    for (long i = 0; i < n; i++) {
+        gap_move(&d->g, i & 1 ? from + dist : from);
+    }
+}
+
+static void bench_move_near(struct doc *d, long n) {
+    move_by(d, n, d->size < 64 ? d->size : 64);
+}
+
+static void bench_move_far(struct doc *d, long n) {
+    move_by(d, n, d->size < 65536 ? d->size : 65536);
+}
+
+static void bench_move_half(struct doc *d, long n) {
+    move_by(d, n, d->size / 2);
+}
+
+/* Type the document into an empty buffer, growing it as it goes */
+static void bench_insert(struct doc *d, long n) {
+    for (long i = 0; i < n; i++) {
+        struct gapbuf b;
+        gap_init(&b, 16);
+        for (size_t pos = 0; pos < d->size; pos++) {
+            gap_insert(&b, d->text[pos]);
+        }
+        gap_free(&b);
+    }
+}
+
+static void bench_rowcol(struct doc *d, long n) {
+    volatile size_t sink = 0;
+    for (long i = 0; i < n; i++) {
+        sink += rowcol_to_pos(&d->g, next_rand() % d->rows, 8);
+    }
+    (void)sink;
+}
+
+static void bench_count_rows(struct doc *d, long n) {
+    volatile size_t sink = 0;
+    (void)d;
+    for (long i = 0; i < n; i++) {
+        sink += count_rows();
+    }
+    (void)sink;
+}
+
+/* Undo and redo one typed run per operation */
+static void bench_undo(struct doc *d, long n) {
+    struct editHistory h;
+    history_init(&h);
+    size_t pos = d->size / 2;
+    gap_move(&d->g, pos);
+    for (int i = 0; i < 16; i++) {
+        gap_insert(&d->g, 'x');
+        history_push(&h, EDIT_INSERT, pos + i, 'x');
+    }
+    for (long i = 0; i < n; i++) {
+        history_undo(&h, &d->g);
+        history_redo(&h, &d->g);
+    }
+    history_undo(&h, &d->g);
+    history_free(&h);
+}
+
+/* Replace every "return" and undo it: two passes over the document */
+static void bench_replace_all(struct doc *d, long n) {
+    struct searchPattern p;
+    struct gapedit *edits = NULL;
+    size_t count = 0, cap = 0, hit;
+    search_compile(&p, "return", 6);
+    for (size_t pos = 0; (hit = search_forward(&p, &d->g, pos, d->size)) != SEARCH_NONE; pos = hit + 6) {
+        if (count == cap) {
+            cap = cap ? cap * 2 : 256;
+            edits = realloc(edits, sizeof(struct gapedit) * cap);
+        }
+        edits[count].pos = hit;
+        edits[count].len = 6;
+        edits[count].text = "result";
+        edits[count].text_len = 6;
+        count++;
+    }
+    search_free(&p);
+    
+    struct editHistory h;
+    history_init(&h);
+    for (long i = 0; i < n; i++) {
+        history_push_replace(&h, &d->g, edits, count);
+        gap_splice(&d->g, edits, count);
+        history_undo(&h, &d->g);
+    }
+    history_free(&h);
+    free(edits);
+}
+
+/* Lex every line of the document from the top */
+static void bench_highlight(struct doc *d, long n) {
+    static unsigned char *hl = NULL;
+    static size_t hl_cap = 0;
+    if (!d->lang) return;
+    for (long i = 0; i < n; i++) {
+        int state = 0;
+        const char *s = d->text, *end = d->text + d->size;
+        while (s < end) {
+            const char *nl = memchr(s, '\n', end - s);
+            int len = (nl ? nl : end) - s;
+            if (hl_cap < (size_t)len) {
+                hl_cap = len;
+                hl = realloc(hl, hl_cap);
+            }
+            state = syntax_lex_line(d->lang, s, len, state, hl);
+            s += len + 1;
+        }
+    }
+}
+
+/* Scan the whole document for a string that is not in it */
+static void bench_search(struct doc *d, long n) {
+    struct searchPattern p;
+    search_compile(&p, "zebra_quagga", 12);
+    for (long i = 0; i < n; i++) {
+        search_forward(&p, &d->g, 0, d->size);
+    }
+    search_free(&p);
+}
+
+/* The same scan with a regex that is not matched anywhere */
+static void bench_regex(struct doc *d, long n) {
+    const char *error;
+    struct regex *re = regex_compile("zebra|quag+a[0-9]", 17, &error);
+    size_t mend;
+    for (long i = 0; i < n; i++) {
+        regex_search(re, &d->g, 0, d->size, &mend);
+    }
+    regex_free(re);
+}
+
+/* Project grep over the document on disk, workers started and joined
+ * each time, for a string that is not in it */
+static void bench_grep(struct doc *d, long n) {
+    struct grepJob job;
+    const char *out;
+    size_t len;
+    struct timespec wait = { 0, 100000 };
+    grep_init(&job);
+    for (long i = 0; i < n; i++) {
+        grep_start(&job, d->path, "zebra_quagga", 12);
+        while (grep_poll(&job, &out, &len) == GREP_RUNNING) nanosleep(&wait, NULL);
+    }
+    grep_stop(&job);
+}
+
+/* Repaint the whole screen, as after a resize */
+static void bench_refresh_full(struct doc *d, long n) {
+    (void)d;
+    for (long i = 0; i < n; i++) {
+        screen_invalidate();
+        editorRefreshScreen();
+    }
+}
+
+/* Redraw with nothing changed, as on every keystroke that only moves */
+static void bench_refresh_idle(struct doc *d, long n) {
+    (void)d;
+    for (long i = 0; i < n; i++) {
+        editorRefreshScreen();
+    }
+}
+
+static const struct bench benches[] = {
+    { "gap_move/64", bench_move_near, 0 },
+    { "gap_move/64K", bench_move_far, 0 },
+    { "gap_move/half", bench_move_half, 0 },
+    { "gap_insert", bench_insert, 1 },
+    { "rowcol_to_pos", bench_rowcol, 0 },
+    { "count_rows", bench_count_rows, 0 },
+    { "undo_redo", bench_undo, 0 },
+    { "replace_all", bench_replace_all, 1 },
+    { "syntax_lex_line", bench_highlight, 1 },
+    { "search", bench_search, 1 },
+    { "regex", bench_regex, 1 },
+    { "grep", bench_grep, 1 },
+    { "refresh/full", bench_refresh_full, 0 },
+    { "refresh/idle", bench_refresh_idle, 0 },
+};
+
+/* Nanoseconds per operation, calibrated to run for MIN_RUN_US */
+static double measure(const struct bench *b, struct doc *d) {
+    long n = 1;
+    double best = 0;
+    for (int round = 0; round < ROUNDS; ) {
+        double t0 = now_us();
+        b->run(d, n);
+        double us = now_us() - t0;
+        if (us < MIN_RUN_US) {
+            n = us > 0 && MIN_RUN_US / us < 100 ? n * (long)(MIN_RUN_US / us + 1) : n * 100;
+            continue;
+        }
+        double ops = (double)n * (b->per_byte ? d->size : 1);
+        double ns = us * 1e3 / ops;
+        if (round++ == 0 || ns < best) best = ns;
+    }
+    return best;
+}
+
+/* -------- baseline -------- */
+struct result {
+    char name[64];
+    size_t size;
+    double ns;
+};
+
+static struct result *baseline = NULL;
+static size_t nbaseline = 0;
+
+/* Read results written by an earlier run */
+static int load_baseline(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -1;
+    char line[256];
+    size_t cap = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        struct result r;
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%63s %zu %lf", r.name, &r.size, &r.ns) != 3) continue;
+        if (nbaseline == cap) {
+            cap = cap ? cap * 2 : 64;
+            baseline = realloc(baseline, cap * sizeof(struct result));
+        }
+        baseline[nbaseline++] = r;
+    }
+    fclose(fp);
+    return 0;
+}
+
+static const struct result *find_baseline(const char *name, size_t size) {
+    for (size_t i = 0; i < nbaseline; i++) {
+        if (baseline[i].size == size && strcmp(baseline[i].name, name) == 0) {
+            return &baseline[i];
+        }
+    }
+    return NULL;
+}
+
+/* -------- documents -------- */
+static int doc_open(struct doc *d, size_t size, const char *dir, char *path, size_t pathcap) {
+    size_t off = 0;
+    d->size = size;
+    d->text = malloc(size ? size : 1);
+    doc_fill(d->text, size, &off);
+    gap_init(&d->g, 1024);
+    gap_load(&d->g, d->text, size);
+    d->rows = gap_line_count(&d->g);
+    
+    snprintf(path, pathcap, "%s/dira-micro-%ld-%zu.c", dir, (long)getpid(), size);
+    if (make_document(path, size) == -1) return -1;
+    editorInit(SCREEN_ROWS, SCREEN_COLS);
+    editorOpen(path);
+    editorRefreshScreen();
+    d->lang = lang_for_file(path);
+    d->path = path;
+    return 0;
+}
+
+static void doc_close(struct doc *d, const char *path) {
+    editorFree();
+    unlink(path);
+    gap_free(&d->g);
+    free(d->text);
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: micro [-s sizes] [-b baseline] [-t percent] [-d dir] [bench...]\n"
+                    "  -s  comma-separated document sizes (default " DEFAULT_SIZES ")\n"
+                    "  -b  compare with the output of an earlier run\n"
+                    "  -t  slowdown that counts as a regression (default 10%%)\n"
+                    "  -d  directory for the generated documents (default $TMPDIR or /tmp)\n"
+                    "  bench names select benchmarks by prefix; results are written as\n"
+                    "  tab-separated name, size, ns/op and unit, plus baseline and change\n");
+    exit(2);
+}
+
+static int selected(const char *name, int argc, char *argv[]) {
+    if (argc == 0) return 1;
+    for (int i = 0; i < argc; i++) {
+        if (strncmp(name, argv[i], strlen(argv[i])) == 0) return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *sizes = DEFAULT_SIZES;
+    const char *dir = getenv("TMPDIR");
+    double threshold = DEFAULT_THRESHOLD;
+    int opt;
+    
+    if (!dir || !*dir) dir = "/tmp";
+    while ((opt = getopt(argc, argv, "s:b:t:d:")) != -1) {
+        switch (opt) {
+            case 's': sizes = optarg; break;
+            case 'b':
+                if (load_baseline(optarg) == -1) {
+                    fprintf(stderr, "micro: %s: %s\n", optarg, strerror(errno));
+                    return 2;
+                }
+                break;
+            case 't': threshold = atof(optarg); break;
+            case 'd': dir = optarg; break;
+            default: usage();
+        }
+    }
+    
+    int null = open("/dev/null", O_WRONLY);
+    editorSetOutput(null);
+    
+    int regressed = 0;
+    printf("# name\tsize\tns_per_op\tunit%s\n", baseline ? "\tbaseline\tchange" : "");
+    for (const char *p = sizes; *p; ) {
+        char *end;
+        size_t size = parse_size(p, &end);
+        if (end == p || (*end && *end != ',') || size == 0) usage();
+        p = *end ? end + 1 : end;
+        
+        struct doc d;
+        char path[4096];
+        if (doc_open(&d, size, dir, path, sizeof(path)) == -1) {
+            fprintf(stderr, "micro: cannot write %s: %s\n", path, strerror(errno));
+            return 2;
+        }
+        for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+            const struct bench *b = &benches[i];
+            if (!selected(b->name, argc - optind, argv + optind)) continue;
+            double ns = measure(b, &d);
+            printf("%s\t%zu\t%.2f\t%s", b->name, size, ns, b->per_byte ? "byte" : "op");
+            const struct result *base = baseline ? find_baseline(b->name, size) : NULL;
+            if (base) {
+                double change = (ns - base->ns) * 100.0 / base->ns;
+                printf("\t%.2f\t%+.1f%%%s", base->ns, change,
+                       change > threshold ? "\tREGRESSED" : "");
+                if (change > threshold) regressed = 1;
+            } else if (baseline) {
+                printf("\t-\t-");
+            }
+            printf("\n");
+            fflush(stdout);
+        }
+        doc_close(&d, path);
+    }
+    
+    close(null);
+    free(baseline);
+    return regressed;
+}
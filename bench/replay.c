@@ -0,0 +1,222 @@
+/* replay.c - Keystroke-replay latency benchmark over libdira */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "dira.h"
+#include "common.h"
+
+#define BENCH_ROWS 50
+#define BENCH_COLS 160
+#define DEFAULT_SIZES "1K,64K,1M,16M,256M,1G"
+
+/* -------- keystroke scripts -------- */
+/* Scripts are raw terminal input, as captured with script(1) --log-in,
+ * so they replay through the same decoder as the keyboard. */
+struct script {
+    const char *name;
+    char *data;
+    size_t len;
+};
+
+/* The built-in script: scroll in, type, move around, select, copy,
+ * paste, cut, undo and redo, and paste from the terminal */
+static const struct {
+    const char *keys;
+    int times;
+} session[] = {
+    { "\x1b[6~", 3 },
+    { "\x1b[B", 5 },
+    { "\x1b[F", 1 },
+    { "\r    int total = count + offset; /* bench */", 5 },
+    { "\x1b[A", 8 },
+    { "\x1b[C", 12 },
+    { "\x1b[D", 6 },
+    { "\x7f", 20 },
+    { "\x1b[1D", 12 },
+    { "\x03", 1 },
+    { "\x1b[B", 2 },
+    { "\x16", 3 },
+    { "\x1b[H", 1 },
+    { "\x1b[1B", 3 },
+    { "\x18", 1 },
+    { "\x1a", 15 },
+    { "\x19", 8 },
+    { "\t", 4 },
+    { "\x1b[3~", 10 },
+    { "\x1b[5~", 3 },
+    { "\x1b[200~\tfor (int i = 0; i < n; i++) {\r\t\tsum += v[i];\r\t}\r\x1b[201~", 4 },
+};
+
+static void script_builtin(struct script *s) {
+    size_t cap = 0;
+    for (size_t i = 0; i < sizeof(session) / sizeof(session[0]); i++) {
+        cap += strlen(session[i].keys) * session[i].times;
+    }
+    s->name = "session";
+    s->data = malloc(cap);
+    s->len = 0;
+    for (size_t i = 0; i < sizeof(session) / sizeof(session[0]); i++) {
+        size_t n = strlen(session[i].keys);
+        for (int k = 0; k < session[i].times; k++) {
+            memcpy(s->data + s->len, session[i].keys, n);
+            s->len += n;
+        }
+    }
+}
+
+static int script_load(struct script *s, const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return -1;
+    size_t cap = 4096;
+    s->name = path;
+    s->data = malloc(cap);
+    s->len = 0;
+    size_t n;
+    while ((n = fread(s->data + s->len, 1, cap - s->len, fp)) > 0) {
+        s->len += n;
+        if (s->len == cap) {
+            cap *= 2;
+            s->data = realloc(s->data, cap);
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+/* -------- timing -------- */
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* p-th percentile of n sorted samples */
+static double percentile(const double *v, size_t n, double p) {
+    if (n == 0) return 0;
+    size_t i = (size_t)(p / 100.0 * (n - 1) + 0.5);
+    return v[i];
+}
+
+static void report(const char *what, double *v, size_t n) {
+    qsort(v, n, sizeof(double), cmp_double);
+    printf("  %-6s p50 %9.1f us   p99 %9.1f us   max %9.1f us\n", what,
+           percentile(v, n, 50), percentile(v, n, 99), n ? v[n - 1] : 0.0);
+}
+
+/* -------- replay -------- */
+static int run(const char *dir, size_t size, const struct script *s, int repeat) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/dira-bench-%ld-%zu.c", dir, (long)getpid(), size);
+    if (make_document(path, size) == -1) {
+        fprintf(stderr, "replay: cannot write %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    
+    double t0 = now_us();
+    editorInit(BENCH_ROWS, BENCH_COLS);
+    editorOpen(path);
+    editorRefreshScreen();
+    double open_us = now_us() - t0;
+    
+    size_t cap = s->len * repeat + 1, nkeys = 0;
+    double *keys = malloc(cap * sizeof(double));
+    double *frames = malloc(cap * sizeof(double));
+    int quit = 0;
+    for (int r = 0; r < repeat && !quit; r++) {
+        size_t off = 0, used;
+        while (off < s->len && !quit) {
+            int key = editorDecodeKey(s->data + off, s->len - off, &used);
+            off += used;
+            double a = now_us();
+            if (key == PASTE_START) {
+                /* a paste is timed as one key */
+                size_t len = editorPasteEnd(s->data + off, s->len - off);
+                editorPaste(s->data + off, len);
+                off += len + sizeof(PASTE_END) - 1;
+                if (off > s->len) off = s->len;
+            } else {
+                quit = editorProcessKey(key);
+            }
+            double b = now_us();
+            editorRefreshScreen();
+            double c = now_us();
+            keys[nkeys] = b - a;
+            frames[nkeys] = c - b;
+            nkeys++;
+        }
+    }
+    
+    editorFree();
+    unlink(path);
+    
+    printf("%zu bytes, %s: %zu keys, open %.1f ms\n", size, s->name, nkeys, open_us / 1e3);
+    report("key", keys, nkeys);
+    report("frame", frames, nkeys);
+    free(keys);
+    free(frames);
+    return 0;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: replay [-s sizes] [-n repeat] [-d dir] [script...]\n"
+                    "  -s  comma-separated document sizes (default " DEFAULT_SIZES ")\n"
+                    "  -n  times to replay each script (default 3)\n"
+                    "  -d  directory for the generated documents (default $TMPDIR or /tmp)\n"
+                    "  scripts are raw terminal input; without one a built-in session is used\n");
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    const char *sizes = DEFAULT_SIZES;
+    const char *dir = getenv("TMPDIR");
+    int repeat = 3;
+    int opt;
+    
+    if (!dir || !*dir) dir = "/tmp";
+    while ((opt = getopt(argc, argv, "s:n:d:")) != -1) {
+        switch (opt) {
+            case 's': sizes = optarg; break;
+            case 'n': repeat = atoi(optarg); break;
+            case 'd': dir = optarg; break;
+            default: usage();
+        }
+    }
+    if (repeat < 1) usage();
+    
+    int nscripts = argc > optind ? argc - optind : 1;
+    struct script *scripts = calloc(nscripts, sizeof(struct script));
+    if (argc > optind) {
+        for (int i = 0; i < nscripts; i++) {
+            if (script_load(&scripts[i], argv[optind + i]) == -1) {
+                fprintf(stderr, "replay: %s: %s\n", argv[optind + i], strerror(errno));
+                return 1;
+            }
+        }
+    } else {
+        script_builtin(&scripts[0]);
+    }
+    
+    int null = open("/dev/null", O_WRONLY);
+    editorSetOutput(null);
+    
+    int failed = 0;
+    for (const char *p = sizes; *p; ) {
+        char *end;
+        size_t size = parse_size(p, &end);
+        if (end == p || (*end && *end != ',')) usage();
+        for (int i = 0; i < nscripts; i++) {
+            if (run(dir, size, &scripts[i], repeat) == -1) failed = 1;
+        }
+        p = *end ? end + 1 : end;
+    }
+    
+    close(null);
+    for (int i = 0; i < nscripts; i++) free(scripts[i].data);
+    free(scripts);
+    return failed;
+}
@@ -0,0 +1,60 @@
+/* dira.h - libdira: the editor core driven by key events, no terminal needed */
+#ifndef DIRA_H
+#define DIRA_H
+
+#include <stddef.h>
+
+/* -------- key definitions -------- */
+enum editorKey {
+    ARROW_LEFT = 1000,
+    ARROW_RIGHT,
+    ARROW_UP,
+    ARROW_DOWN,
+    DEL_KEY,
+    HOME_KEY,
+    END_KEY,
+    PAGE_UP,
+    PAGE_DOWN,
+    PASTE_START     /* ESC[200~: pasted text follows, up to PASTE_END */
+};
+
+/* Bracketed paste: the terminal ends pasted text with this */
+#define PASTE_END "\x1b[201~"
+
+/* Set up an empty editor for a rows x cols screen, with the user's
+ * config and languages loaded. The welcome screen shows until a file
+ * is opened or a key is pressed. */
+void editorInit(int rows, int cols);
+
+/* Load filename, replaying any edits a crash left in its journal */
+void editorOpen(const char *filename);
+
+/* Apply one key as returned by editorDecodeKey; returns 1 if the key
+ * asks the editor to quit */
+int editorProcessKey(int key);
+
+/* Insert text the terminal pasted between PASTE_START and PASTE_END
+ * as one edit, undone as one and drawn once */
+void editorPaste(const char *text, size_t len);
+
+/* Draw the current state and write what changed to the output */
+void editorRefreshScreen(void);
+
+/* Background work between keys: save progress and auto-save.
+ * Returns 1 if the screen should be refreshed. */
+int editorIdle(void);
+
+/* Decode the key at the start of len bytes of terminal input;
+ * *used is set to the number of bytes it took */
+int editorDecodeKey(const char *s, size_t len, size_t *used);
+
+/* Offset of PASTE_END in s[0..len), or len if it is not there */
+size_t editorPasteEnd(const char *s, size_t len);
+
+/* Write frames to fd instead of standard output */
+void editorSetOutput(int fd);
+
+/* Wait for a running save, delete the journal and free all state */
+void editorFree(void);
+
+#endif /* DIRA_H */
@@ -1,45 +1,195 @@
 #include "buffer.h"
+#include "piece.h"
 #include <stdlib.h>
 #include <string.h>
 
+/* gap_load copies and indexes text in blocks that stay in cache */
+#define LOAD_BLOCK 65536
+
 
 struct gapbuf g;
 
-void gap_init(struct gapbuf *g, int initial_cap) {
+void gap_init(struct gapbuf *g, size_t initial_cap) {
     g->cap = initial_cap > 0 ? initial_cap : 1024;
     g->buf = malloc(g->cap);
     g->gap_start = 0;
     g->gap_end = g->cap;
+    g->nl_cap = 64;
+    g->nl = malloc(g->nl_cap * sizeof(size_t));
+    g->nl_gap_start = 0;
+    g->nl_gap_end = g->nl_cap;
+    g->dirty = 0;
+    g->pt = NULL;
+    g->snap = NULL;
+}
+
+void gap_free(struct gapbuf *g) {
+    free(g->buf);
+    free(g->nl);
+    if (g->pt) pt_free(g->pt);
+}
+
+size_t gap_length(struct gapbuf *g) {
+    if (g->pt) return g->pt->len;
+    return g->cap - (g->gap_end - g->gap_start);
+}
+
+size_t gap_cursor(struct gapbuf *g) {
+    return g->pt ? g->pt->cursor : g->gap_start;
+}
+
+/* -------- newline index -------- */
+static size_t nl_count(struct gapbuf *g) {
+    return g->nl_gap_start + (g->nl_cap - g->nl_gap_end);
+}
+
+/* Position of the i-th newline in the document */
+static size_t nl_at(struct gapbuf *g, size_t i) {
+    if (i < g->nl_gap_start) return g->nl[i];
+    return gap_length(g) - g->nl[g->nl_gap_end + (i - g->nl_gap_start)];
+}
+
+static void nl_reserve(struct gapbuf *g) {
+    if (g->nl_gap_start < g->nl_gap_end) return;
+    size_t newcap = g->nl_cap + g->nl_cap / 2;
+    size_t *nn = malloc(newcap * sizeof(size_t));
+    size_t prefix = g->nl_gap_start;
+    size_t suffix = g->nl_cap - g->nl_gap_end;
+    if (prefix) memcpy(nn, g->nl, prefix * sizeof(size_t));
+    if (suffix) memcpy(nn + newcap - suffix, g->nl + g->nl_gap_end, suffix * sizeof(size_t));
+    g->nl_gap_end = newcap - suffix;
+    g->nl_cap = newcap;
+    free(g->nl);
+    g->nl = nn;
 }
 
-void gap_free(struct gapbuf *g) { free(g->buf); }
+/* -------- snapshots -------- */
+/* Before the gap storage is written to, hand the current block to the
+ * snapshot sharing it and carry on in a copy */
+static void detach_snapshot(struct gapbuf *g) {
+    if (!g->snap || g->pt) return;
+    char *nb = malloc(g->cap);
+    memcpy(nb, g->buf, g->gap_start);
+    memcpy(nb + g->gap_end, g->buf + g->gap_end, g->cap - g->gap_end);
+    g->snap->owned = g->buf;
+    g->snap = NULL;
+    g->buf = nb;
+}
 
-int gap_length(struct gapbuf *g) { return g->cap - (g->gap_end - g->gap_start); }
+/* -------- change tracking -------- */
+static void mark_insert(struct gapbuf *g, size_t pos, size_t n) {
+    if (!g->dirty) {
+        g->dirty = 1;
+        g->dirty_lo = pos;
+        g->dirty_hi = pos + n;
+        return;
+    }
+    if (pos < g->dirty_lo) g->dirty_lo = pos;
+    if (g->dirty_hi >= pos) g->dirty_hi += n;
+    if (g->dirty_hi < pos + n) g->dirty_hi = pos + n;
+}
 
-void gap_move(struct gapbuf *g, int pos) {
-    if (pos < 0) pos = 0;
-    int len = gap_length(g);
+static void mark_delete(struct gapbuf *g, size_t pos, size_t n) {
+    if (!g->dirty) {
+        g->dirty = 1;
+        g->dirty_lo = g->dirty_hi = pos;
+        return;
+    }
+    if (pos < g->dirty_lo) g->dirty_lo = pos;
+    if (g->dirty_hi > pos) g->dirty_hi = g->dirty_hi - pos > n ? g->dirty_hi - n : pos;
+    if (g->dirty_hi < pos) g->dirty_hi = pos;
+}
+
+int gap_take_changes(struct gapbuf *g, size_t *lo, size_t *hi) {
+    if (!g->dirty) return 0;
+    *lo = g->dirty_lo;
+    *hi = g->dirty_hi;
+    g->dirty = 0;
+    return 1;
+}
+
+void gap_load(struct gapbuf *g, const char *data, size_t len) {
+    if (g->pt) {
+        pt_free(g->pt);
+        g->pt = NULL;
+    }
+    detach_snapshot(g);
+    free(g->buf);
+    g->cap = len + len / 16 + 1024;
+    g->buf = malloc(g->cap);
+    g->gap_start = len;
+    g->gap_end = g->cap;
+    g->nl_gap_start = 0;
+    g->nl_gap_end = g->nl_cap;
+    
+    for (size_t off = 0; off < len; off += LOAD_BLOCK) {
+        size_t n = len - off < LOAD_BLOCK ? len - off : LOAD_BLOCK;
+        memcpy(g->buf + off, data + off, n);
+        const char *p = g->buf + off;
+        const char *end = p + n;
+        while ((p = memchr(p, '\n', end - p)) != NULL) {
+            nl_reserve(g);
+            g->nl[g->nl_gap_start++] = p - g->buf;
+            p++;
+        }
+    }
+    
+    /* everything changed */
+    g->dirty = 1;
+    g->dirty_lo = 0;
+    g->dirty_hi = len;
+}
+
+void gap_open_mapped(struct gapbuf *g, const char *map, size_t len) {
+    if (g->pt) pt_free(g->pt);
+    g->pt = pt_open(map, len);
+    g->gap_start = 0;
+    g->gap_end = g->cap;
+    g->nl_gap_start = 0;
+    g->nl_gap_end = g->nl_cap;
+    g->dirty = 1;
+    g->dirty_lo = 0;
+    g->dirty_hi = len;
+}
+
+void gap_move(struct gapbuf *g, size_t pos) {
+    size_t len = gap_length(g);
     if (pos > len) pos = len;
+    if (g->pt) {
+        g->pt->cursor = pos;
+        return;
+    }
+    if (pos != g->gap_start) detach_snapshot(g);
     if (pos < g->gap_start) {
-        int move_len = g->gap_start - pos;
+        size_t move_len = g->gap_start - pos;
         g->gap_end -= move_len;
         memmove(g->buf + g->gap_end, g->buf + pos, move_len);
         g->gap_start = pos;
+        while (g->nl_gap_start > 0 && g->nl[g->nl_gap_start - 1] >= pos) {
+            size_t at = g->nl[--g->nl_gap_start];
+            g->nl[--g->nl_gap_end] = len - at;
+        }
     } else if (pos > g->gap_start) {
-        int move_len = pos - g->gap_start;
+        size_t move_len = pos - g->gap_start;
         memmove(g->buf + g->gap_start, g->buf + g->gap_end, move_len);
         g->gap_start += move_len;
         g->gap_end += move_len;
+        while (g->nl_gap_end < g->nl_cap && len - g->nl[g->nl_gap_end] < pos) {
+            size_t at = len - g->nl[g->nl_gap_end++];
+            g->nl[g->nl_gap_start++] = at;
+        }
     }
 }
 
-void gap_insert(struct gapbuf *g, char c) {
-    if (g->gap_start == g->gap_end) {
-        int gap_size = g->cap / 2;
-        int newcap = g->cap + gap_size;
+/* Grow the gap to hold at least n bytes */
+static void gap_reserve(struct gapbuf *g, size_t n) {
+    if (g->gap_end - g->gap_start < n) {
+        size_t need = gap_length(g) + n;
+        size_t newcap = g->cap + g->cap / 2;
+        if (newcap < need + need / 16) newcap = need + need / 16;
         char *nb = malloc(newcap);
-        int prefix = g->gap_start;
-        int suffix = g->cap - g->gap_end;
+        size_t prefix = g->gap_start;
+        size_t suffix = g->cap - g->gap_end;
         if (prefix) memcpy(nb, g->buf, prefix);
         if (suffix) memcpy(nb + newcap - suffix, g->buf + g->gap_end, suffix);
         g->gap_end = newcap - suffix;
@@ -47,35 +197,325 @@ void gap_insert(struct gapbuf *g, char c) {
         free(g->buf);
         g->buf = nb;
     }
+}
+
+void gap_insert(struct gapbuf *g, char c) {
+    if (g->pt) {
+        mark_insert(g, g->pt->cursor, 1);
+        pt_insert(g->pt, g->pt->cursor++, c);
+        return;
+    }
+    detach_snapshot(g);
+    gap_reserve(g, 1);
+    if (c == '\n') {
+        nl_reserve(g);
+        g->nl[g->nl_gap_start++] = g->gap_start;
+    }
+    mark_insert(g, g->gap_start, 1);
     g->buf[g->gap_start++] = c;
 }
 
+void gap_insert_n(struct gapbuf *g, const char *s, size_t n) {
+    if (n == 0) return;
+    if (g->pt) {
+        mark_insert(g, g->pt->cursor, n);
+        pt_insert_n(g->pt, g->pt->cursor, s, n);
+        g->pt->cursor += n;
+        return;
+    }
+    detach_snapshot(g);
+    gap_reserve(g, n);
+    memcpy(g->buf + g->gap_start, s, n);
+    const char *p = s;
+    const char *end = s + n;
+    while ((p = memchr(p, '\n', end - p)) != NULL) {
+        nl_reserve(g);
+        g->nl[g->nl_gap_start++] = g->gap_start + (p - s);
+        p++;
+    }
+    mark_insert(g, g->gap_start, n);
+    g->gap_start += n;
+}
+
 int gap_backspace(struct gapbuf *g) {
+    if (g->pt) {
+        if (g->pt->cursor == 0) return 0;
+        pt_delete(g->pt, --g->pt->cursor);
+        mark_delete(g, g->pt->cursor, 1);
+        return 1;
+    }
     if (g->gap_start == 0) return 0;
     g->gap_start--;
+    if (g->buf[g->gap_start] == '\n') g->nl_gap_start--;
+    mark_delete(g, g->gap_start, 1);
     return 1;
 }
 
 int gap_delete(struct gapbuf *g) {
+    if (g->pt) {
+        if (g->pt->cursor == g->pt->len) return 0;
+        pt_delete(g->pt, g->pt->cursor);
+        mark_delete(g, g->pt->cursor, 1);
+        return 1;
+    }
     if (g->gap_end == g->cap) return 0;
+    if (g->buf[g->gap_end] == '\n') g->nl_gap_end++;
     g->gap_end++;
+    mark_delete(g, g->gap_start, 1);
     return 1;
 }
 
-int gap_get(struct gapbuf *g, char *out, int outcap) {
-    int len = gap_length(g);
-    if (outcap < len) return -1;
-    int prefix = g->gap_start;
-    int suffix = g->cap - g->gap_end;
+void gap_delete_range(struct gapbuf *g, size_t start, size_t end) {
+    size_t len = gap_length(g);
+    if (end > len) end = len;
+    gap_move(g, start);
+    if (start >= end) return;
+    size_t n = end - start;
+    if (g->pt) {
+        pt_delete_range(g->pt, start, n);
+        mark_delete(g, start, n);
+        return;
+    }
+    while (g->nl_gap_end < g->nl_cap && len - g->nl[g->nl_gap_end] < end) g->nl_gap_end++;
+    g->gap_end += n;
+    mark_delete(g, start, n);
+}
+
+/* Append src's text in [start, end) at dst's gap, a cache-sized block at
+ * a time so each block is indexed while it is still hot */
+static void splice_copy(struct gapbuf *dst, struct gapbuf *src, size_t start, size_t end) {
+    size_t n;
+    const char *p;
+    while (start < end && (p = gap_span(src, start, &n)) != NULL) {
+        if (n > end - start) n = end - start;
+        if (n > LOAD_BLOCK) n = LOAD_BLOCK;
+        gap_insert_n(dst, p, n);
+        start += n;
+    }
+}
+
+void gap_splice(struct gapbuf *g, const struct gapedit *edits, size_t n) {
+    size_t len = gap_length(g), newlen = len;
+    for (size_t i = 0; i < n; i++) newlen = newlen - edits[i].len + edits[i].text_len;
+    
+    /* g becomes the new buffer; old reads the text from the old storage */
+    struct gapbuf old = *g;
+    g->pt = NULL;
+    g->snap = NULL;
+    g->cap = newlen + newlen / 16 + 1024;
+    g->buf = malloc(g->cap);
+    g->gap_start = 0;
+    g->gap_end = g->cap;
+    g->nl_gap_start = 0;
+    g->nl_gap_end = g->nl_cap;
+    
+    size_t pos = 0;
+    for (size_t i = 0; i < n; i++) {
+        splice_copy(g, &old, pos, edits[i].pos);
+        gap_insert_n(g, edits[i].text, edits[i].text_len);
+        pos = edits[i].pos + edits[i].len;
+    }
+    splice_copy(g, &old, pos, len);
+    
+    /* a snapshot still reading the old storage takes it over */
+    if (old.snap && old.pt) {
+        old.snap->owned_pt = old.pt;
+        free(old.buf);
+    } else if (old.snap) {
+        old.snap->owned = old.buf;
+    } else {
+        if (old.pt) pt_free(old.pt);
+        free(old.buf);
+    }
+    
+    g->dirty = 1;
+    g->dirty_lo = 0;
+    g->dirty_hi = newlen;
+}
+
+void gap_copy_range(struct gapbuf *g, size_t start, size_t end, char *out) {
+    size_t len = gap_length(g);
+    if (end > len) end = len;
+    if (start >= end) return;
+    if (g->pt) {
+        size_t n;
+        const char *p;
+        for (size_t pos = start; pos < end && (p = pt_span(g->pt, pos, &n)) != NULL; pos += n) {
+            if (n > end - pos) n = end - pos;
+            memcpy(out + (pos - start), p, n);
+        }
+        return;
+    }
+    /* the part before the gap, then the part after it */
+    if (start < g->gap_start) {
+        size_t n = (end < g->gap_start ? end : g->gap_start) - start;
+        memcpy(out, g->buf + start, n);
+        out += n;
+        start += n;
+    }
+    if (start < end) {
+        memcpy(out, g->buf + g->gap_end + (start - g->gap_start), end - start);
+    }
+}
+
+int gap_get(struct gapbuf *g, char *out, size_t outcap) {
+    if (outcap < gap_length(g)) return -1;
+    if (g->pt) {
+        size_t n;
+        const char *p;
+        for (size_t pos = 0; (p = pt_span(g->pt, pos, &n)) != NULL; pos += n) {
+            memcpy(out + pos, p, n);
+        }
+        return 0;
+    }
+    size_t prefix = g->gap_start;
+    size_t suffix = g->cap - g->gap_end;
     if (prefix) memcpy(out, g->buf, prefix);
     if (suffix) memcpy(out + prefix, g->buf + g->gap_end, suffix);
-    return len;
+    return 0;
+}
+
+unsigned long long gap_hash_bytes(unsigned long long h, const char *s, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+unsigned long long gap_hash(struct gapbuf *g) {
+    unsigned long long h = GAP_HASH_SEED;
+    size_t n;
+    const char *p;
+    for (size_t pos = 0; (p = gap_span(g, pos, &n)) != NULL; pos += n) {
+        h = gap_hash_bytes(h, p, n);
+    }
+    return h;
+}
+
+void gap_snapshot(struct gapbuf *g, struct gapsnap *s) {
+    size_t cap = 2, n;
+    const char *p;
+    s->spans = malloc(sizeof(struct gapspan) * cap);
+    s->nspans = 0;
+    s->len = gap_length(g);
+    s->owned = NULL;
+    s->owned_pt = NULL;
+    for (size_t pos = 0; (p = gap_span(g, pos, &n)) != NULL; pos += n) {
+        if (s->nspans == cap) {
+            cap *= 2;
+            s->spans = realloc(s->spans, sizeof(struct gapspan) * cap);
+        }
+        s->spans[s->nspans].data = p;
+        s->spans[s->nspans].len = n;
+        s->nspans++;
+    }
+    if (g->pt) pt_freeze(g->pt);
+    g->snap = s;
+}
+
+void gap_snapshot_release(struct gapbuf *g, struct gapsnap *s) {
+    if (g->snap == s) {
+        if (g->pt) pt_thaw(g->pt);
+        g->snap = NULL;
+    }
+    free(s->owned);
+    if (s->owned_pt) pt_free(s->owned_pt);
+    free(s->spans);
 }
 
-char gap_char_at(struct gapbuf *g, int pos) {
-    if (pos < 0 || pos >= gap_length(g)) return '\0';
+char gap_char_at(struct gapbuf *g, size_t pos) {
+    if (pos >= gap_length(g)) return '\0';
+    if (g->pt) return pt_char_at(g->pt, pos);
     if (pos < g->gap_start) return g->buf[pos];
     return g->buf[g->gap_end + (pos - g->gap_start)];
 }
 
+const char *gap_span(struct gapbuf *g, size_t pos, size_t *len) {
+    if (g->pt) return pt_span(g->pt, pos, len);
+    if (pos < g->gap_start) {
+        *len = g->gap_start - pos;
+        return g->buf + pos;
+    }
+    size_t phys = g->gap_end + (pos - g->gap_start);
+    if (phys >= g->cap) {
+        *len = 0;
+        return NULL;
+    }
+    *len = g->cap - phys;
+    return g->buf + phys;
+}
 
+const char *gap_span_before(struct gapbuf *g, size_t pos, size_t *len) {
+    if (g->pt) return pt_span_before(g->pt, pos, len);
+    if (pos == 0 || pos > gap_length(g)) {
+        *len = 0;
+        return NULL;
+    }
+    if (pos <= g->gap_start) {
+        *len = pos;
+        return g->buf;
+    }
+    *len = pos - g->gap_start;
+    return g->buf + g->gap_end;
+}
+
+const char *gap_text(struct gapbuf *g, size_t start, size_t end, char **scratch, size_t *scratch_cap) {
+    size_t n;
+    const char *p = gap_span(g, start, &n);
+    if (!p || n >= end - start) return p;
+    
+    if (*scratch_cap < end - start) {
+        *scratch_cap = end - start;
+        *scratch = realloc(*scratch, *scratch_cap);
+    }
+    size_t off = 0;
+    while (p && off < end - start) {
+        if (n > end - start - off) n = end - start - off;
+        memcpy(*scratch + off, p, n);
+        off += n;
+        p = gap_span(g, start + off, &n);
+    }
+    return *scratch;
+}
+
+size_t gap_line_count(struct gapbuf *g) {
+    if (g->pt) return pt_line_count(g->pt);
+    return nl_count(g) + 1;
+}
+
+size_t gap_lines_upto(struct gapbuf *g, size_t limit) {
+    if (g->pt) return pt_lines_upto(g->pt, limit);
+    return nl_count(g) + 1 < limit ? nl_count(g) + 1 : limit;
+}
+
+int gap_line_count_ready(struct gapbuf *g, size_t *count) {
+    if (g->pt) return pt_line_count_ready(g->pt, count);
+    *count = nl_count(g) + 1;
+    return 1;
+}
+
+size_t gap_line_start(struct gapbuf *g, size_t row) {
+    if (g->pt) return pt_line_start(g->pt, row);
+    if (row == 0) return 0;
+    if (row > nl_count(g)) return gap_length(g);
+    return nl_at(g, row - 1) + 1;
+}
+
+size_t gap_line_end(struct gapbuf *g, size_t row) {
+    if (g->pt) return pt_line_end(g->pt, row);
+    if (row >= nl_count(g)) return gap_length(g);
+    return nl_at(g, row);
+}
+
+size_t gap_line_of(struct gapbuf *g, size_t pos) {
+    if (g->pt) return pt_line_of(g->pt, pos);
+    /* count newlines strictly before pos */
+    size_t lo = 0, hi = nl_count(g);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (nl_at(g, mid) < pos) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
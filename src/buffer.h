@@ -2,38 +2,165 @@
 #ifndef BUFFER_H
 #define BUFFER_H
 
+#include <stddef.h>
+
+struct piecetable;
+struct gapsnap;
+
 struct gapbuf {
     char *buf;
-    int cap;
-    int gap_start;
-    int gap_end;
+    size_t cap;
+    size_t gap_start;
+    size_t gap_end;
+    /* Newline index, itself a gap array. Entries before nl_gap_start hold
+     * the positions of newlines in front of the text gap; entries from
+     * nl_gap_end on hold each newline's distance from the end of the
+     * buffer, so edits at the gap never renumber them. */
+    size_t *nl;
+    size_t nl_cap;
+    size_t nl_gap_start;
+    size_t nl_gap_end;
+    /* Range touched by edits since the last gap_take_changes */
+    int dirty;
+    size_t dirty_lo;
+    size_t dirty_hi;
+    /* When set, the text lives in this piece table instead and every
+     * gap_* operation is forwarded to it */
+    struct piecetable *pt;
+    /* Snapshot sharing the current storage, if any */
+    struct gapsnap *snap;
+};
+
+/* A run of text inside a snapshot */
+struct gapspan {
+    const char *data;
+    size_t len;
+};
+
+/* The text as it stood when the snapshot was taken, readable from
+ * another thread while editing goes on: edits that would overwrite
+ * storage the snapshot points into copy it first. */
+struct gapsnap {
+    struct gapspan *spans;
+    size_t nspans;
+    size_t len;
+    char *owned;            /* storage an edit has since moved off */
+    struct piecetable *owned_pt;    /* a piece table since replaced */
+};
+
+/* One edit of a splice: [pos, pos + len) becomes text[0, text_len) */
+struct gapedit {
+    size_t pos;
+    size_t len;
+    const char *text;
+    size_t text_len;
 };
 
 /* Initialize gap buffer */
-void gap_init(struct gapbuf *g, int initial_cap);
+void gap_init(struct gapbuf *g, size_t initial_cap);
 
 /* Free gap buffer memory */
 void gap_free(struct gapbuf *g);
 
+/* Replace the contents with len bytes of text, sizing the buffer once
+ * and indexing newlines in the same pass */
+void gap_load(struct gapbuf *g, const char *data, size_t len);
+
+/* Replace the contents with a piece table over a read-only mapping of
+ * len bytes. The buffer takes ownership of the mapping. Opening reads
+ * no text: the file starts as one piece, and its newlines are indexed
+ * on a background thread. */
+void gap_open_mapped(struct gapbuf *g, const char *map, size_t len);
+
+/* Insertion point: where the gap (or piece table cursor) sits */
+size_t gap_cursor(struct gapbuf *g);
+
 /* Get length of text (excluding gap) */
-int gap_length(struct gapbuf *g);
+size_t gap_length(struct gapbuf *g);
 
 /* Move gap to position */
-void gap_move(struct gapbuf *g, int pos);
+void gap_move(struct gapbuf *g, size_t pos);
 
 /* Insert character at gap */
 void gap_insert(struct gapbuf *g, char c);
 
+/* Insert n bytes at gap in one step, leaving the gap after them */
+void gap_insert_n(struct gapbuf *g, const char *s, size_t n);
+
 /* Delete character before gap (backspace) */
 int gap_backspace(struct gapbuf *g);
 
 /* Delete character after gap (delete key) */
 int gap_delete(struct gapbuf *g);
 
-/* Get entire buffer contents */
-int gap_get(struct gapbuf *g, char *out, int outcap);
+/* Delete [start, end) in one step, leaving the gap at start */
+void gap_delete_range(struct gapbuf *g, size_t start, size_t end);
+
+/* Apply n edits, sorted by position and not overlapping, by streaming
+ * the text through them into a new buffer sized once for the result.
+ * O(length + edits) however many edits there are; the gap is left at
+ * the end. A piece table is replaced by a plain gap buffer. */
+void gap_splice(struct gapbuf *g, const struct gapedit *edits, size_t n);
+
+/* Copy the text in [start, end) to out, which holds end - start bytes */
+void gap_copy_range(struct gapbuf *g, size_t start, size_t end, char *out);
+
+/* Get entire buffer contents; returns -1 if outcap is too small */
+int gap_get(struct gapbuf *g, char *out, size_t outcap);
+
+/* 64-bit FNV-1a hash of text fed in order, starting from GAP_HASH_SEED */
+#define GAP_HASH_SEED 14695981039346656037ULL
+unsigned long long gap_hash_bytes(unsigned long long h, const char *s, size_t n);
+
+/* Hash of the whole text */
+unsigned long long gap_hash(struct gapbuf *g);
+
+/* Take a snapshot of the text; O(1) for a gap buffer and O(pieces) for
+ * a piece table. The buffer must outlive it. */
+void gap_snapshot(struct gapbuf *g, struct gapsnap *s);
+
+/* Drop a snapshot once its reader has finished */
+void gap_snapshot_release(struct gapbuf *g, struct gapsnap *s);
 
 /* Get character at specific position */
-char gap_char_at(struct gapbuf *g, int pos);
+char gap_char_at(struct gapbuf *g, size_t pos);
+
+/* Contiguous run of text starting at pos, read in place without copying.
+ * Sets *len to the run length; returns NULL at or past the end. */
+const char *gap_span(struct gapbuf *g, size_t pos, size_t *len);
+
+/* Contiguous run of text ending at pos, for reading backward; returns
+ * its start and sets *len, or NULL at the start of the buffer */
+const char *gap_span_before(struct gapbuf *g, size_t pos, size_t *len);
+
+/* Text [start, end) as one contiguous run: read in place when possible,
+ * otherwise copied into *scratch, which is grown as needed */
+const char *gap_text(struct gapbuf *g, size_t start, size_t end, char **scratch, size_t *scratch_cap);
+
+/* Fetch and reset the range edited since the last call.
+ * Returns 0 when nothing changed. */
+int gap_take_changes(struct gapbuf *g, size_t *lo, size_t *hi);
+
+/* Number of lines (newlines + 1). O(1), except that a mapped file may
+ * first have to count the rest of its text; see gap_lines_upto. */
+size_t gap_line_count(struct gapbuf *g);
+
+/* Number of lines, or limit if there are at least that many. A mapped
+ * file counts lines only as far as limit. */
+size_t gap_lines_upto(struct gapbuf *g, size_t limit);
+
+/* Set *count and return 1 if the number of lines is known without
+ * counting more of a mapped file than its index thread has reached */
+int gap_line_count_ready(struct gapbuf *g, size_t *count);
+
+/* Position of the first character of a row, O(1).
+ * Rows past the end map to the end of the buffer. */
+size_t gap_line_start(struct gapbuf *g, size_t row);
+
+/* Position of the newline ending a row (or buffer length), O(1) */
+size_t gap_line_end(struct gapbuf *g, size_t row);
+
+/* Row containing position, O(log n) */
+size_t gap_line_of(struct gapbuf *g, size_t pos);
 
 #endif /* BUFFER_H */
@@ -1,6 +1,13 @@
 /* config.c - Configuration system */
+#define _POSIX_C_SOURCE 200809L
+
 #include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <ctype.h>
+#include <unistd.h>
 
 void config_default(Config *cfg) {
     cfg->tab_width = 4;
@@ -12,4 +19,84 @@ void config_default(Config *cfg) {
     cfg->show_welcome = 1;
     cfg->create_backup = 0;
     cfg->auto_save_interval = 0;
+    cfg->history_limit = 64;
+}
+
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s)) s++;
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) *--end = '\0';
+    return s;
+}
+
+static const struct {
+    const char *key;
+    size_t offset;
+} int_keys[] = {
+    { "tab_width", offsetof(Config, tab_width) },
+    { "show_line_numbers", offsetof(Config, show_line_numbers) },
+    { "auto_indent", offsetof(Config, auto_indent) },
+    { "syntax_highlighting", offsetof(Config, syntax_highlighting) },
+    { "show_status_bar", offsetof(Config, show_status_bar) },
+    { "show_welcome", offsetof(Config, show_welcome) },
+    { "create_backup", offsetof(Config, create_backup) },
+    { "auto_save_interval", offsetof(Config, auto_save_interval) },
+    { "history_limit", offsetof(Config, history_limit) },
+};
+
+/* Numbers, or yes/on/true and no/off/false for switches */
+static int parse_value(const char *value) {
+    if (strcmp(value, "yes") == 0 || strcmp(value, "on") == 0 || strcmp(value, "true") == 0) return 1;
+    return atoi(value);
+}
+
+int config_load(Config *cfg, const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -1;
+    
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        char *eq = strchr(line, '=');
+        if (line[0] == '#' || !eq) continue;
+        *eq = '\0';
+        char *key = trim(line);
+        char *value = trim(eq + 1);
+        
+        if (strcmp(key, "color_scheme") == 0) {
+            snprintf(cfg->color_scheme, sizeof(cfg->color_scheme), "%s", value);
+            continue;
+        }
+        for (size_t i = 0; i < sizeof(int_keys) / sizeof(int_keys[0]); i++) {
+            if (strcmp(key, int_keys[i].key) == 0) {
+                *(int *)((char *)cfg + int_keys[i].offset) = parse_value(value);
+            }
+        }
+    }
+    
+    fclose(fp);
+    return 0;
+}
+
+const char* config_get_path(void) {
+    static char path[4096];
+    
+    const char *env = getenv("DIRA_CONFIG");
+    if (env && *env) return env;
+    
+    const char *home = getenv("HOME");
+    if (home) {
+        snprintf(path, sizeof(path), "%s/.config/dira/dira.conf", home);
+        if (access(path, R_OK) == 0) return path;
+    }
+    return "config/dira.conf";
+}
+
+const char* config_get_dir(void) {
+    static char dir[4096];
+    
+    snprintf(dir, sizeof(dir), "%s", config_get_path());
+    char *slash = strrchr(dir, '/');
+    if (slash) *slash = '\0';
+    else strcpy(dir, ".");
+    return dir;
 }
@@ -13,10 +13,18 @@ typedef struct {
     int show_welcome;
     int create_backup;
     int auto_save_interval;
+    int history_limit;          /* megabytes of undo history, 0 for no limit */
 } Config;
 
 void config_default(Config *cfg);
 
+/* Read "key = value" settings from path over the current values.
+ * Returns -1 if the file cannot be opened. */
+int config_load(Config *cfg, const char *path);
+
 const char* config_get_path(void);
 
+/* Directory holding dira.conf and the *.lang definitions */
+const char* config_get_dir(void);
+
 #endif /* CONFIG_H */
@@ -0,0 +1,356 @@
+/* display.c - Shadow screen grid and terminal output */
+#define _POSIX_C_SOURCE 200809L
+
+#include "display.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/uio.h>
+
+#define ABUF_BLOCK 16384
+#define ABUF_IOV_MAX 64
+
+/* Equal cells shorter than this between two changes are rewritten
+ * rather than skipped, since a cursor move costs about as much. */
+#define SKIP_MIN 6
+
+/* -------- append buffer -------- */
+/* Output is gathered in fixed-size blocks that are kept across frames,
+ * so the buffer grows to the largest frame once and then stops
+ * allocating. Blocks are handed to writev without being joined. */
+struct abufBlock {
+    char *data;
+    int len;
+};
+
+static struct abufBlock *abuf_blocks = NULL;
+static int abuf_nblocks = 0;    /* blocks allocated */
+static int abuf_cur = 0;        /* block being filled */
+static int abuf_len = 0;        /* bytes queued in total */
+static struct iovec abuf_iov[ABUF_IOV_MAX];
+static int abuf_fd = STDOUT_FILENO;
+
+static void abufNextBlock(void) {
+    if (abuf_nblocks > 0 && abuf_blocks[abuf_cur].len < ABUF_BLOCK) return;
+    if (abuf_nblocks > 0) abuf_cur++;
+    if (abuf_cur < abuf_nblocks) return;
+    abuf_blocks = realloc(abuf_blocks, sizeof(struct abufBlock) * (abuf_nblocks + 1));
+    abuf_blocks[abuf_nblocks].data = malloc(ABUF_BLOCK);
+    abuf_blocks[abuf_nblocks].len = 0;
+    abuf_nblocks++;
+}
+
+void abufAppend(const char *s, int len) { 
+    while (len > 0) {
+        abufNextBlock();
+        struct abufBlock *b = &abuf_blocks[abuf_cur];
+        int n = ABUF_BLOCK - b->len;
+        if (n > len) n = len;
+        memcpy(b->data + b->len, s, n);
+        b->len += n;
+        abuf_len += n;
+        s += n;
+        len -= n;
+    }
+}
+
+/* Write all of iov[0..cnt), resuming after short writes and waiting
+ * for the terminal to drain on EAGAIN. Returns -1 on a hard error. */
+static int writeAll(int fd, struct iovec *iov, int cnt) {
+    while (cnt > 0) {
+        ssize_t n = writev(fd, iov, cnt);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct pollfd pfd = { fd, POLLOUT, 0 };
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            return -1;
+        }
+        while (cnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if (cnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+void abufSetOutput(int fd) {
+    abuf_fd = fd;
+}
+
+void abufFlush(void) { 
+    int failed = 0;
+    for (int i = 0; i < abuf_nblocks && i <= abuf_cur; ) {
+        int cnt = 0;
+        for (; i < abuf_nblocks && i <= abuf_cur && cnt < ABUF_IOV_MAX; i++) {
+            if (abuf_blocks[i].len == 0) continue;
+            abuf_iov[cnt].iov_base = abuf_blocks[i].data;
+            abuf_iov[cnt].iov_len = abuf_blocks[i].len;
+            cnt++;
+        }
+        if (!failed && writeAll(abuf_fd, abuf_iov, cnt) == -1) failed = 1;
+    }
+    for (int i = 0; i < abuf_nblocks; i++) abuf_blocks[i].len = 0;
+    abuf_cur = 0;
+    abuf_len = 0;
+    /* the terminal holds a partial frame; repaint it next time */
+    if (failed) screen_invalidate();
+}
+
+/* -------- screen grid -------- */
+static struct cell *front = NULL;   /* what the terminal shows */
+static struct cell *back = NULL;    /* the frame being drawn */
+static int srows = 0, scols = 0;
+static int cur_row = 0, cur_col = 0;
+static int shown_row = -1, shown_col = -1;
+static int full_redraw = 1;
+
+static const struct cell blank = { " ", 1, 0, 0 };
+
+static void grid_fill(struct cell *grid, int n) {
+    if (n <= 0) return;
+    grid[0] = blank;
+    for (int done = 1; done < n; done *= 2) {
+        memcpy(grid + done, grid, sizeof(struct cell) * (n - done < done ? n - done : done));
+    }
+}
+
+void screen_begin(int rows, int cols) {
+    if (rows < 0) rows = 0;
+    if (cols < 0) cols = 0;
+    if (rows != srows || cols != scols) {
+        free(front);
+        free(back);
+        srows = rows;
+        scols = cols;
+        front = malloc(sizeof(struct cell) * (srows * scols + 1));
+        back = malloc(sizeof(struct cell) * (srows * scols + 1));
+        full_redraw = 1;
+    }
+    grid_fill(back, srows * scols);
+}
+
+/* Decode the UTF-8 sequence at s; returns its length, or 0 if it is
+ * not a complete, shortest-form encoding of a code point */
+static int utf8_decode(const unsigned char *s, int len, unsigned *cp) {
+    int n;
+    unsigned min;
+    if (s[0] < 0x80) {
+        *cp = s[0];
+        return 1;
+    } else if (s[0] >= 0xc2 && s[0] <= 0xdf) {
+        n = 2;
+        min = 0x80;
+        *cp = s[0] & 0x1f;
+    } else if (s[0] >= 0xe0 && s[0] <= 0xef) {
+        n = 3;
+        min = 0x800;
+        *cp = s[0] & 0x0f;
+    } else if (s[0] >= 0xf0 && s[0] <= 0xf4) {
+        n = 4;
+        min = 0x10000;
+        *cp = s[0] & 0x07;
+    } else {
+        return 0;
+    }
+    if (len < n) return 0;
+    for (int i = 1; i < n; i++) {
+        if ((s[i] & 0xc0) != 0x80) return 0;
+        *cp = (*cp << 6) | (s[i] & 0x3f);
+    }
+    if (*cp < min || *cp > 0x10ffff || (*cp >= 0xd800 && *cp <= 0xdfff)) return 0;
+    return n;
+}
+
+/* Marks that combine with the character before them */
+static int is_combining(unsigned cp) {
+    return (cp >= 0x0300 && cp <= 0x036f) || (cp >= 0x1ab0 && cp <= 0x1aff) ||
+           (cp >= 0x1dc0 && cp <= 0x1dff) || (cp >= 0x200b && cp <= 0x200f) ||
+           (cp >= 0x20d0 && cp <= 0x20ff) || (cp >= 0xfe00 && cp <= 0xfe0f) ||
+           (cp >= 0xfe20 && cp <= 0xfe2f);
+}
+
+/* East Asian wide and fullwidth characters, and emoji */
+static int is_wide(unsigned cp) {
+    return (cp >= 0x1100 && cp <= 0x115f) || (cp >= 0x2e80 && cp <= 0x303e) ||
+           (cp >= 0x3041 && cp <= 0x33ff) || (cp >= 0x3400 && cp <= 0x4dbf) ||
+           (cp >= 0x4e00 && cp <= 0x9fff) || (cp >= 0xa000 && cp <= 0xa4cf) ||
+           (cp >= 0xac00 && cp <= 0xd7a3) || (cp >= 0xf900 && cp <= 0xfaff) ||
+           (cp >= 0xfe30 && cp <= 0xfe4f) || (cp >= 0xff00 && cp <= 0xff60) ||
+           (cp >= 0xffe0 && cp <= 0xffe6) || (cp >= 0x1f300 && cp <= 0x1f64f) ||
+           (cp >= 0x1f900 && cp <= 0x1f9ff) || (cp >= 0x20000 && cp <= 0x3fffd);
+}
+
+int screen_char_len(const char *s, int len, int *width) {
+    const unsigned char *u = (const unsigned char *)s;
+    unsigned cp;
+    *width = 1;
+    /* plain ASCII, the common case: marks only follow in UTF-8 */
+    if (u[0] < 0x80 && (len == 1 || u[1] < 0x80)) return 1;
+    int n = utf8_decode(u, len, &cp);
+    if (n == 0 || cp < 32 || cp == 127 || is_combining(cp)) return 1;
+    if (is_wide(cp)) *width = 2;
+    for (;;) {
+        int m = n < len && u[n] >= 0x80 ? utf8_decode(u + n, len - n, &cp) : 0;
+        if (m == 0 || !is_combining(cp)) return n;
+        n += m;
+    }
+}
+
+static void cell_set(int row, int col, const char *s, int len, int fg, int attr) {
+    if (row < 0 || row >= srows || col < 0 || col >= scols) return;
+    struct cell *c = &back[row * scols + col];
+    memcpy(c->ch, s, len);
+    c->len = (unsigned char)len;
+    c->fg = (unsigned char)fg;
+    c->attr = (unsigned char)attr;
+}
+
+void screen_put(int row, int col, char ch, int fg, int attr) {
+    if (row < 0 || row >= srows || col < 0 || col >= scols) return;
+    unsigned char uc = (unsigned char)ch;
+    if (ch == '\t') ch = ' ';
+    else if (uc < 32 || uc >= 127) ch = '?';
+    struct cell *c = &back[row * scols + col];
+    c->ch[0] = ch;
+    c->len = 1;
+    c->fg = (unsigned char)fg;
+    c->attr = (unsigned char)attr;
+}
+
+void screen_put_char(int row, int col, const char *s, int len, int width, int fg, int attr) {
+    if (len == 1 || (width == 2 && col + 1 >= scols)) {
+        screen_put(row, col, len == 1 ? s[0] : '?', fg, attr);
+        return;
+    }
+    /* keep the character whole; drop combining marks that do not fit */
+    const unsigned char *u = (const unsigned char *)s;
+    unsigned cp;
+    int keep = utf8_decode(u, len, &cp);
+    while (keep < len) {
+        int n = utf8_decode(u + keep, len - keep, &cp);
+        if (keep + n > CELL_BYTES) break;
+        keep += n;
+    }
+    cell_set(row, col, s, keep, fg, attr);
+    if (width == 2) cell_set(row, col + 1, "", 0, fg, attr);
+}
+
+int screen_write(int row, int col, const char *s, int len, int fg, int attr) {
+    int i = 0;
+    while (i < len && col < scols) {
+        int width;
+        int n = screen_char_len(s + i, len - i, &width);
+        screen_put_char(row, col, s + i, n, width, fg, attr);
+        col += width;
+        i += n;
+    }
+    return col;
+}
+
+void screen_cursor(int row, int col) {
+    cur_row = row;
+    cur_col = col;
+}
+
+void screen_invalidate(void) {
+    full_redraw = 1;
+}
+
+static int cell_eq(const struct cell *a, const struct cell *b) {
+    return a->ch[0] == b->ch[0] && a->len == b->len && a->fg == b->fg && a->attr == b->attr &&
+           (a->len <= 1 || memcmp(a->ch, b->ch, a->len) == 0);
+}
+
+static void emit_move(int row, int col) {
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "\x1b[%d;%dH", row + 1, col + 1);
+    abufAppend(buf, len);
+}
+
+static void emit_pen(const struct cell *c) {
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "\x1b[0%s%s",
+                       (c->attr & ATTR_BOLD) ? ";1" : "",
+                       (c->attr & ATTR_REVERSE) ? ";7" : "");
+    if (c->fg) len += snprintf(buf + len, sizeof(buf) - len, ";%d", c->fg);
+    buf[len++] = 'm';
+    abufAppend(buf, len);
+}
+
+int screen_flush(void) {
+    struct cell pen = { "", 0, 0xff, 0xff };   /* unknown */
+    int term_row = -1, term_col = -1;
+    int hidden = 0;
+    
+    if (full_redraw) {
+        abufAppend("\x1b[?25l\x1b[0m\x1b[2J", 14);
+        hidden = 1;
+        pen = blank;
+        grid_fill(front, srows * scols);
+        shown_row = shown_col = -1;
+        full_redraw = 0;
+    }
+    
+    for (int r = 0; r < srows; r++) {
+        struct cell *f = &front[r * scols];
+        struct cell *b = &back[r * scols];
+        /* equal bytes are equal cells; the converse need not hold, as
+         * bytes past a cell's length may differ */
+        if (memcmp(f, b, sizeof(struct cell) * scols) == 0) continue;
+        int c = 0;
+        while (c < scols) {
+            if (cell_eq(&f[c], &b[c])) {
+                c++;
+                continue;
+            }
+            /* find where this run of changes ends, bridging short gaps */
+            int end = c + 1;
+            for (;;) {
+                while (end < scols && !cell_eq(&f[end], &b[end])) end++;
+                int next = end;
+                while (next < scols && next - end < SKIP_MIN && cell_eq(&f[next], &b[next])) next++;
+                if (next < scols && next - end < SKIP_MIN) end = next;
+                else break;
+            }
+            
+            if (!hidden) {
+                abufAppend("\x1b[?25l", 6);
+                hidden = 1;
+            }
+            if (term_row != r || term_col != c) emit_move(r, c);
+            for (; c < end; c++) {
+                if (b[c].fg != pen.fg || b[c].attr != pen.attr) {
+                    emit_pen(&b[c]);
+                    pen = b[c];
+                }
+                /* the cell after a wide character is already covered */
+                abufAppend(b[c].ch, b[c].len);
+                f[c] = b[c];
+            }
+            term_row = r;
+            term_col = c < scols ? c : -1;
+        }
+    }
+    
+    if (hidden || cur_row != shown_row || cur_col != shown_col) {
+        emit_move(cur_row, cur_col);
+        shown_row = cur_row;
+        shown_col = cur_col;
+    }
+    if (hidden) abufAppend("\x1b[?25h", 6);
+    
+    int bytes = abuf_len;
+    abufFlush();
+    return bytes;
+}
@@ -0,0 +1,60 @@
+/* display.h - Shadow screen grid and terminal output */
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+/* Cell attribute flags */
+#define ATTR_BOLD    0x01
+#define ATTR_REVERSE 0x02
+
+/* Bytes a cell holds: a UTF-8 character and a combining mark or two */
+#define CELL_BYTES 8
+
+/* One screen cell: a character as UTF-8, ANSI foreground (0 = default)
+ * and flags. The cell after a double-width character is empty. */
+struct cell {
+    char ch[CELL_BYTES];
+    unsigned char len;
+    unsigned char fg;
+    unsigned char attr;
+};
+
+/* Append raw bytes to the output buffer */
+void abufAppend(const char *s, int len);
+
+/* Send output to fd instead of standard output */
+void abufSetOutput(int fd);
+
+/* Write the output buffer to the terminal */
+void abufFlush(void);
+
+/* Start a new frame: resize the grid if needed and blank it */
+void screen_begin(int rows, int cols);
+
+/* Length of the character at s, which has len bytes left: a UTF-8
+ * sequence and the combining marks after it, or 1 for any other byte.
+ * Sets *width to the columns it takes on screen. */
+int screen_char_len(const char *s, int len, int *width);
+
+/* Draw one byte; control bytes and bytes that are not ASCII show as
+ * '?', a tab as a space. Out-of-range positions are ignored. */
+void screen_put(int row, int col, char ch, int fg, int attr);
+
+/* Draw the character s[0..len) as measured by screen_char_len. A
+ * double-width character also takes the next cell, or shows as '?'
+ * where there is none. */
+void screen_put_char(int row, int col, const char *s, int len, int width, int fg, int attr);
+
+/* Draw a UTF-8 string clipped to the row; returns the column after it */
+int screen_write(int row, int col, const char *s, int len, int fg, int attr);
+
+/* Place the terminal cursor for this frame */
+void screen_cursor(int row, int col);
+
+/* Emit only the cells that changed since the last frame.
+ * Returns the number of bytes written to the terminal. */
+int screen_flush(void);
+
+/* Forget what the terminal shows; the next flush repaints everything */
+void screen_invalidate(void);
+
+#endif /* DISPLAY_H */
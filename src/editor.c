@@ -0,0 +1,1469 @@
+/* editor.c - Editor state, key handling and screen drawing */
+#define _POSIX_C_SOURCE 200809L
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "editor.h"
+#include "buffer.h"
+#include "history.h"
+#include "selection.h"
+#include "syntax.h"
+#include "config.h"
+#include "display.h"
+#include "lang.h"
+#include "save.h"
+#include "journal.h"
+#include "search.h"
+#include "regex.h"
+#include "grep.h"
+
+#define TAB_STOP 4
+#define PIECE_TABLE_MIN (64 * 1024 * 1024)
+/* A journal this large is folded into the file by a save */
+#define JOURNAL_COMPACT_SIZE (8 * 1024 * 1024)
+/* Text either side of the visible columns searched for regex matches */
+#define REGEX_CONTEXT 4096
+
+/* -------- editor state -------- */
+struct editorConfig {
+    size_t cx, cy;
+    size_t rowoff, coloff;
+    int screenrows, screencols;
+    char *filename;
+    int lines_ready;            /* the status bar shows the line count */
+    unsigned long dirty;        /* edit generation, bumped by every change */
+    unsigned long saved;        /* generation last written to disk */
+    struct saveJob save;
+    time_t last_save;           /* when the last save started */
+    struct journal journal;
+    size_t journal_mark;        /* journal position at the save snapshot */
+    char *undo;                 /* history encoded at the save snapshot */
+    size_t undo_len;
+    char statusmsg[80];
+    struct editHistory history;
+    struct selection sel;
+    struct clipboard clip;
+    struct hlCache hl;
+    Config config;
+    int searching;              /* the Ctrl-F prompt is open */
+    char *search_query;
+    size_t search_len;
+    int search_direction;
+    size_t search_match_pos;    /* current match, or SEARCH_NONE */
+    size_t search_match_end;
+    size_t search_origin;       /* where the cursor was when it opened */
+    size_t search_cx, search_cy, search_rowoff, search_coloff;
+    struct searchPattern search;
+    int search_regex;           /* the query is a regular expression */
+    struct regex *regex;        /* compiled query, NULL if it is invalid */
+    const char *regex_error;
+    int replacing;              /* asking what to replace matches with */
+    char *replace_text;
+    size_t replace_len;
+    struct grepJob grep;
+    int grep_prompt;            /* the Ctrl-P prompt is open */
+    char *grep_query;
+    size_t grep_len;
+    int grep_view;              /* the buffer holds grep results */
+    char *grep_origin;          /* file open before them, to go back to */
+    size_t grep_origin_row;
+    int show_welcome;
+    int frame_bytes;
+};
+
+static struct editorConfig E;
+static struct gapbuf g;
+
+/* -------- position helpers -------- */
+size_t get_line_length(size_t row) {
+    return gap_line_end(&g, row) - gap_line_start(&g, row);
+}
+
+int get_line_indent(size_t row) {
+    size_t pos = gap_line_start(&g, row);
+    size_t end = gap_line_end(&g, row);
+    int indent = 0;
+    
+    while (pos < end) {
+        char c = gap_char_at(&g, pos);
+        if (c == ' ') indent++;
+        else if (c == '\t') indent += TAB_STOP;
+        else break;
+        pos++;
+    }
+    
+    return indent;
+}
+
+size_t count_rows(void) {
+    return gap_line_count(&g);
+}
+
+/* -------- file I/O -------- */
+/* Read a whole stream that cannot be mapped (pipes, devices) */
+static char *editorReadAll(int fd, size_t *len) {
+    size_t cap = 65536;
+    char *data = malloc(cap);
+    ssize_t n;
+    
+    *len = 0;
+    while ((n = read(fd, data + *len, cap - *len)) != 0) {
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        *len += n;
+        if (*len == cap) {
+            cap *= 2;
+            data = realloc(data, cap);
+        }
+    }
+    return data;
+}
+
+static void editorLoadFile(const char *filename) {
+    E.filename = strdup(filename);
+    E.lines_ready = 0;
+    syntax_select(&E.hl, E.filename);
+    
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) return;
+    
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return;
+    }
+    
+    if (S_ISREG(st.st_mode) && (uintmax_t)st.st_size > SIZE_MAX) {
+        snprintf(E.statusmsg, sizeof(E.statusmsg), "File too large!");
+    } else if (S_ISREG(st.st_mode)) {
+        size_t len = st.st_size;
+        char *data = len ? mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        if (data != MAP_FAILED && len >= PIECE_TABLE_MIN) {
+            /* large files are edited in place over the mapping, as plain
+             * text: highlighting keeps state for every line */
+            gap_open_mapped(&g, data, len);
+            syntax_select(&E.hl, NULL);
+        } else if (data != MAP_FAILED) {
+            posix_madvise(data, len, POSIX_MADV_SEQUENTIAL);
+            gap_load(&g, data, len);
+            munmap(data, len);
+        } else if (len) {
+            data = editorReadAll(fd, &len);
+            gap_load(&g, data, len);
+            free(data);
+        }
+    } else {
+        size_t len;
+        char *data = editorReadAll(fd, &len);
+        gap_load(&g, data, len);
+        free(data);
+    }
+    
+    close(fd);
+    E.dirty = E.saved = 0;
+}
+
+/* Ctrl-S snapshots the buffer and returns at once; a writer thread
+ * saves the snapshot while editing goes on */
+void editorSave(void) {
+    if (E.filename == NULL) {
+        snprintf(E.statusmsg, sizeof(E.statusmsg), "No filename!");
+        return;
+    }
+    if (E.save.running) {
+        snprintf(E.statusmsg, sizeof(E.statusmsg), "Save already in progress");
+        return;
+    }
+    
+    E.save.generation = E.dirty;
+    E.journal_mark = journal_size(&E.journal);
+    E.undo = history_serialize(&E.history, &E.undo_len);
+    E.last_save = time(NULL);
+    if (save_start(&E.save, &g, E.filename, E.config.create_backup) == -1) {
+        free(E.undo);
+        E.undo = NULL;
+        snprintf(E.statusmsg, sizeof(E.statusmsg), "Save failed: %s", strerror(errno));
+        return;
+    }
+    snprintf(E.statusmsg, sizeof(E.statusmsg), "Saving...");
+}
+
+/* Once a save has been written, mark the buffer clean as of its
+ * snapshot and bring the journal and undo sidecar up to date */
+int editorSaveFinished(int state) {
+    if (state == SAVE_DONE) {
+        E.saved = E.save.generation;
+        journal_rebase(&E.journal, E.journal_mark, &E.save.st);
+        history_store(&E.history, E.undo, E.undo_len, E.save.hash);
+    }
+    free(E.undo);
+    E.undo = NULL;
+    return state;
+}
+
+/* Report on a running save; returns 1 when the status line changed */
+int editorPollSave(void) {
+    if (!E.save.running) return 0;
+    
+    size_t written;
+    size_t total = E.save.snap.len;
+    switch (save_poll(&E.save, &g, &written)) {
+        case SAVE_RUNNING:
+            snprintf(E.statusmsg, sizeof(E.statusmsg), "Saving... %d%%",
+                     total ? (int)(written * 100.0 / total) : 0);
+            break;
+        case SAVE_DONE:
+            editorSaveFinished(SAVE_DONE);
+            snprintf(E.statusmsg, sizeof(E.statusmsg), "Saved! %zu bytes", total);
+            break;
+        case SAVE_FAILED:
+            editorSaveFinished(SAVE_FAILED);
+            snprintf(E.statusmsg, sizeof(E.statusmsg), "Save failed (%s): %s",
+                     E.save.failed, strerror(E.save.err));
+            break;
+    }
+    return 1;
+}
+
+/* Returns 1 once a mapped file's line count becomes known */
+static int editorPollLines(void) {
+    size_t count;
+    if (E.lines_ready || !gap_line_count_ready(&g, &count)) return 0;
+    E.lines_ready = 1;
+    return 1;
+}
+
+/* Save when auto_save_interval seconds have passed since the last save,
+ * or when the journal has grown large; returns 1 if a save started */
+int editorAutoSave(void) {
+    if (!E.filename || E.save.running || E.dirty == E.saved) return 0;
+    int due = E.config.auto_save_interval > 0 &&
+              time(NULL) - E.last_save >= E.config.auto_save_interval;
+    if (!due && journal_unsaved(&E.journal) < JOURNAL_COMPACT_SIZE) return 0;
+    editorSave();
+    return 1;
+}
+
+/* Journal replay: apply one recorded run as the edit that made it */
+int editorReplayEdit(void *arg, int op, size_t pos, const char *text, size_t n) {
+    (void)arg;
+    size_t len = gap_length(&g);
+    if (pos > len || (op == JOURNAL_DELETE && n > len - pos)) return -1;
+    
+    if (op == JOURNAL_INSERT) {
+        gap_move(&g, pos);
+        gap_insert_n(&g, text, n);
+        history_push_n(&E.history, n == 1 && text[0] == '\n' ? EDIT_INSERT_NEWLINE : EDIT_INSERT,
+                       pos, text, n);
+    } else if (op == JOURNAL_DELETE) {
+        char *old = malloc(n);
+        gap_copy_range(&g, pos, pos + n, old);
+        gap_delete_range(&g, pos, pos + n);
+        history_push_n(&E.history, n == 1 && old[0] == '\n' ? EDIT_DELETE_NEWLINE : EDIT_DELETE,
+                       pos, old, n);
+        free(old);
+    } else {
+        return -1;
+    }
+    E.dirty++;
+    return 0;
+}
+
+/* Pick up edits a crash left in the journal, then journal from here on */
+void editorRecover(void) {
+    size_t n = journal_open(&E.journal, E.filename, editorReplayEdit, NULL);
+    E.history.journal = &E.journal;
+    E.last_save = time(NULL);
+    if (n) {
+        pos_to_rowcol(&g, gap_cursor(&g), &E.cy, &E.cx);
+        snprintf(E.statusmsg, sizeof(E.statusmsg), "Recovered %zu unsaved edits", n);
+    }
+}
+
+/* Finish with the open file and leave an empty, unnamed buffer */
+static void editorClose(void) {
+    editorSaveFinished(save_wait(&E.save, &g));
+    journal_close(&E.journal);
+    history_free(&E.history);
+    free(E.filename);
+    E.filename = NULL;
+    syntax_select(&E.hl, NULL);
+    gap_load(&g, "", 0);
+    E.cx = E.cy = 0;
+    E.rowoff = E.coloff = 0;
+    E.dirty = E.saved = 0;
+    selection_clear(&E.sel);
+}
+
+/* -------- status bar -------- */
+void editorDrawStatusBar(void) {
+    int y = E.screenrows - 2;
+    
+    char status[80];
+    char rstatus[80];
+    char lines[24] = "?";
+    size_t count;
+    /* a huge file's lines are shown unknown until they are indexed */
+    if (gap_line_count_ready(&g, &count)) snprintf(lines, sizeof(lines), "%zu", count);
+    int len = snprintf(status, sizeof(status), " %.20s - %s lines %s",
+        E.filename ? E.filename : E.grep_view ? "[grep]" : "[No Name]",
+        lines,
+        E.dirty != E.saved ? "(modified)" : "");
+    size_t hist = history_size(&E.history);
+    int rlen = snprintf(rstatus, sizeof(rstatus), "undo %zu%s%s | %zu,%zu ",
+        hist >= 1 << 20 ? hist >> 20 : hist >> 10, hist >= 1 << 20 ? "M" : "K",
+        E.history.truncated ? "+" : "", E.cy + 1, E.cx + 1);
+    
+    if (len > E.screencols) len = E.screencols;
+    screen_write(y, 0, status, len, 0, ATTR_REVERSE);
+    for (int x = len; x < E.screencols; x++) {
+        screen_put(y, x, ' ', 0, ATTR_REVERSE);
+    }
+    if (len + rlen <= E.screencols) {
+        screen_write(y, E.screencols - rlen, rstatus, rlen, 0, ATTR_REVERSE);
+    }
+    
+    int msglen = strlen(E.statusmsg);
+    if (msglen > E.screencols) msglen = E.screencols;
+    screen_write(y + 1, 0, E.statusmsg, msglen, 0, 0);
+}
+
+/* -------- welcome screen -------- */
+const char* welcome_lines[] = {
+    "",
+    "        ########  #### ########     ###    ",
+    "        ##     ##  ##  ##     ##   ## ##   ",
+    "        ##     ##  ##  ##     ##  ##   ##  ",
+    "        ##     ##  ##  ########  ##     ## ",
+    "        ##     ##  ##  ##   ##   ######### ",
+    "        ##     ##  ##  ##    ##  ##     ## ",
+    "        ########  #### ##     ## ##     ## ",
+    "",
+    "                DIRA version 1.0",
+    "            Terminal Text Editor",
+    "",
+    "  +------------------------------------------------------------------+",
+    "  |                      QUICK START GUIDE                           |",
+    "  +------------------------------------------------------------------+",
+    "  |                                                                  |",
+    "  |  BASIC EDITING            SELECTION & CLIPBOARD                 |",
+    "  |  ==============            =====================                 |",
+    "  |  Arrow Keys ..... Move     Shift+Arrows ... Select text         |",
+    "  |  Home/End ....... Line     Ctrl-A ......... Select all          |",
+    "  |  Page Up/Down ... Scroll   Ctrl-C ......... Copy                |",
+    "  |  Backspace/Del .. Remove   Ctrl-X ......... Cut                 |",
+    "  |  Tab ............ Spaces   Ctrl-V ......... Paste               |",
+    "  |  Enter .......... Newline  Escape ......... Clear selection     |",
+    "  |                                                                  |",
+    "  |  FILE OPERATIONS          EDITING COMMANDS                      |",
+    "  |  ================          ================                      |",
+    "  |  Ctrl-S ......... Save     Ctrl-Z ......... Undo                |",
+    "  |  Ctrl-Q ......... Quit     Ctrl-Y ......... Redo                |",
+    "  |  ./editor file .. Open     Ctrl-F ......... Find/Replace        |",
+    "  |  Ctrl-P ......... Grep                                          |",
+    "  |                                                                  |",
+    "  |  FEATURES                                                        |",
+    "  |  ========                                                        |",
+    "  |  * Syntax highlighting for C, Python, Go, shell, config         |",
+    "  |  * Line numbers with dynamic width                              |",
+    "  |  * Auto-indentation                                             |",
+    "  |  * Efficient gap buffer                                         |",
+    "  |  * Memory-efficient undo/redo                                   |",
+    "  |                                                                  |",
+    "  +------------------------------------------------------------------+",
+    "",
+    "                Press any key to start editing...",
+    "",
+    NULL
+};
+
+void drawWelcomeScreen(void) {
+    screen_begin(E.screenrows, E.screencols);
+    
+    int welcome_lines_count = 0;
+    while (welcome_lines[welcome_lines_count] != NULL) {
+        welcome_lines_count++;
+    }
+    
+    int padding = (E.screenrows - welcome_lines_count) / 2;
+    if (padding < 0) padding = 0;
+    
+    for (int y = 0; y < E.screenrows - 2; y++) {
+        int i = y - padding;
+        if (i < 0 || i >= welcome_lines_count) {
+            screen_put(y, 0, '~', 0, 0);
+            continue;
+        }
+        
+        const char *line = welcome_lines[i];
+        int len = strlen(line);
+        
+        int left_padding = 0;
+        if (len < E.screencols) {
+            left_padding = (E.screencols - len) / 2;
+        }
+        
+        int fg = 0, attr = 0;
+        if (strstr(line, "####") != NULL) {
+            fg = 36; attr = ATTR_BOLD;
+        } else if (strstr(line, "DIRA version") != NULL) {
+            fg = 33; attr = ATTR_BOLD;
+        } else if (strstr(line, "Terminal Text Editor") != NULL) {
+            fg = 90;
+        } else if (strstr(line, "QUICK START GUIDE") != NULL) {
+            fg = 32; attr = ATTR_BOLD;
+        } else if (strstr(line, "+---") != NULL || strstr(line, "| ") != NULL) {
+            fg = 34;
+        } else if (strstr(line, "BASIC EDITING") != NULL || 
+                   strstr(line, "SELECTION") != NULL ||
+                   strstr(line, "FILE OPERATIONS") != NULL || 
+                   strstr(line, "EDITING COMMANDS") != NULL ||
+                   strstr(line, "FEATURES") != NULL) {
+            fg = 37; attr = ATTR_BOLD;
+        } else if (strstr(line, "Press any key") != NULL) {
+            fg = 35; attr = ATTR_BOLD;
+        }
+        
+        screen_write(y, left_padding, line, len, fg, attr);
+    }
+    
+    int y = E.screenrows - 2;
+    char status[] = " Welcome to DIRA - Press any key to start";
+    int slen = screen_write(y, 0, status, strlen(status), 0, ATTR_REVERSE);
+    while (slen < E.screencols) {
+        screen_put(y, slen++, ' ', 0, ATTR_REVERSE);
+    }
+    
+    screen_cursor(y + 1, 0);
+    screen_flush();
+}
+
+/* -------- screen refresh -------- */
+void editorScroll(void) {
+    if (E.cy < E.rowoff) {
+        E.rowoff = E.cy;
+    }
+    if (E.cy >= E.rowoff + E.screenrows - 2) {
+        E.rowoff = E.cy - E.screenrows + 3;
+    }
+    
+    if (E.cx < E.coloff) {
+        E.coloff = E.cx;
+    }
+    if (E.cx >= E.coloff + E.screencols - 5) {
+        E.coloff = E.cx - E.screencols + 6;
+    }
+}
+
+/* Scratch space for visible text that straddles the gap */
+static char *render_scratch = NULL;
+static size_t render_scratch_cap = 0;
+
+/* Per-column search marks for the row being drawn */
+#define MARK_MATCH 1
+#define MARK_CURRENT 2
+static char *match_marks = NULL;
+static size_t match_marks_cap = 0;
+
+/* Match of the query lying within [start, end): the first one if dir
+ * is positive, else the last. Sets *mend to where it ends. */
+static size_t editorFind(size_t start, size_t end, int dir, size_t *mend) {
+    if (E.search_regex && dir > 0) {
+        return E.regex ? regex_search(E.regex, &g, start, end, mend) : SEARCH_NONE;
+    }
+    if (E.search_regex) {
+        size_t hit = E.regex ? regex_search_backward(E.regex, &g, start, end, mend) : SEARCH_NONE;
+        if (hit == SEARCH_NONE) return hit;
+        /* the last match to start may lie inside an earlier one, as the
+         * 5 of 345 does for [0-9]+; step to the match going forward
+         * from the start of the line would land on instead */
+        size_t from = gap_line_start(&g, gap_line_of(&g, hit));
+        if (hit - from > REGEX_CONTEXT) from = hit - REGEX_CONTEXT;
+        if (from < start) from = start;
+        while (from < hit) {
+            size_t e, h = regex_search(E.regex, &g, from, end, &e);
+            if (h >= hit) break;
+            if (e > hit) {
+                *mend = e;
+                return h;
+            }
+            from = e > h ? e : h + 1;
+        }
+        return hit;
+    }
+    size_t hit = dir > 0 ? search_forward(&E.search, &g, start, end)
+                         : search_backward(&E.search, &g, start, end);
+    *mend = hit + E.search_len;
+    return hit;
+}
+
+/* Mark the search matches showing in [vis_start, vis_end) of a row;
+ * returns 0 if there are none */
+static int editorMarkMatches(size_t line_start, size_t line_end, size_t vis_start, size_t vis_end) {
+    if (!E.searching || E.search_len == 0) return 0;
+    /* a literal match can only start this far left of the screen */
+    size_t reach = E.search_regex ? REGEX_CONTEXT : E.search_len - 1;
+    size_t lo = vis_start - line_start > reach ? vis_start - reach : line_start;
+    size_t hi = line_end - vis_end > reach ? vis_end + reach : line_end;
+    size_t mend;
+    size_t hit = editorFind(lo, hi, 1, &mend);
+    if (hit == SEARCH_NONE) return 0;
+    
+    if (match_marks_cap < vis_end - vis_start) {
+        match_marks_cap = vis_end - vis_start;
+        match_marks = realloc(match_marks, match_marks_cap);
+    }
+    memset(match_marks, 0, vis_end - vis_start);
+    for (; hit != SEARCH_NONE; hit = editorFind(hit + 1, hi, 1, &mend)) {
+        char mark = hit == E.search_match_pos ? MARK_CURRENT : MARK_MATCH;
+        size_t from = hit > vis_start ? hit : vis_start;
+        size_t to = mend < vis_end ? mend : vis_end;
+        for (size_t pos = from; pos < to; pos++) {
+            if (match_marks[pos - vis_start] != MARK_CURRENT) match_marks[pos - vis_start] = mark;
+        }
+    }
+    return 1;
+}
+
+void editorDrawRow(size_t row, int y, int x0, int textcols) {
+    if (textcols <= 0) return;
+    size_t line_start = gap_line_start(&g, row);
+    size_t line_end = gap_line_end(&g, row);
+    size_t vis_start = line_start + E.coloff;
+    if (vis_start >= line_end) return;
+    size_t vis_end = vis_start + textcols;
+    if (vis_end > line_end) vis_end = line_end;
+    const char *text = gap_text(&g, vis_start, vis_end, &render_scratch, &render_scratch_cap);
+    
+    int nspans;
+    const struct hlSpan *spans = syntax_row(&E.hl, &g, row, &nspans);
+    int span = 0;
+    size_t span_end = nspans ? spans[0].len : 0;
+    int marked = editorMarkMatches(line_start, line_end, vis_start, vis_end);
+    
+    /* a character takes its colours from its first byte */
+    int x = x0;
+    for (size_t pos = vis_start; pos < vis_end; ) {
+        size_t col = pos - line_start;
+        const char *s = text + (pos - vis_start);
+        int width;
+        int n = screen_char_len(s, vis_end - pos, &width);
+        while (span < nspans && col >= span_end) {
+            if (++span < nspans) span_end += spans[span].len;
+        }
+        if (selection_contains(&E.sel, row, col)) {
+            screen_put_char(y, x, s, n, width, 0, ATTR_REVERSE);
+        } else if (marked && match_marks[pos - vis_start]) {
+            int fg = match_marks[pos - vis_start] == MARK_CURRENT ? 36 : 33;
+            screen_put_char(y, x, s, n, width, fg, ATTR_REVERSE);
+        } else {
+            enum editorHighlight hl = span < nspans ? spans[span].hl : HL_NORMAL;
+            screen_put_char(y, x, s, n, width, highlight_to_color(hl), 0);
+        }
+        x += width;
+        pos += n;
+    }
+}
+
+/* Screen column of the cursor within the text area: the width of what
+ * is drawn between the left edge and the cursor */
+static int editorCursorColumn(void) {
+    size_t line_start = gap_line_start(&g, E.cy);
+    size_t start = line_start + E.coloff;
+    size_t end = line_start + E.cx;
+    if (end <= start) return 0;
+    const char *text = gap_text(&g, start, end, &render_scratch, &render_scratch_cap);
+    int col = 0;
+    for (size_t i = 0; i < end - start; ) {
+        int width;
+        i += screen_char_len(text + i, end - start - i, &width);
+        col += width;
+    }
+    return col;
+}
+
+void editorRefreshScreen(void) {
+    if (E.show_welcome) {
+        drawWelcomeScreen();
+        return;
+    }
+    
+    editorScroll();
+    syntax_update(&E.hl, &g);
+    screen_begin(E.screenrows, E.screencols);
+    
+    /* only the rows on screen need counting */
+    size_t total_rows = gap_lines_upto(&g, E.rowoff + E.screenrows);
+    size_t count;
+    if (!gap_line_count_ready(&g, &count)) count = E.rowoff + E.screenrows;
+    int num_width = snprintf(NULL, 0, "%zu", count) + 1;
+    /* a terminal narrower than the line numbers has no text area */
+    int textcols = E.screencols - num_width - 1;
+    if (textcols < 0) textcols = 0;
+    
+    char linenum[32];
+    for (int y = 0; y < E.screenrows - 2; y++) {
+        size_t row = E.rowoff + y;
+        if (row >= total_rows) {
+            screen_put(y, 0, '~', 0, 0);
+        } else {
+            int ln_len = snprintf(linenum, sizeof(linenum), "%*zu ", num_width, row + 1);
+            int x0 = screen_write(y, 0, linenum, ln_len, 36, 0);
+            editorDrawRow(row, y, x0, textcols);
+        }
+    }
+    
+    editorDrawStatusBar();
+    
+    screen_cursor(E.cy - E.rowoff, editorCursorColumn() + num_width + 1);
+    E.frame_bytes = screen_flush();
+}
+int is_shift_arrow(int key) {
+    return key & 0x1000;
+}
+
+int get_base_key(int key) {
+    return key & 0xFFF;
+}
+
+/* -------- cursor movement -------- */
+void editorMoveCursor(int key) {
+    /* no key moves more than a screen past the top row */
+    size_t total_rows = gap_lines_upto(&g, E.rowoff + 2 * E.screenrows);
+    
+    switch (key) {
+        case ARROW_LEFT:
+            if (E.cx > 0) {
+                E.cx--;
+            } else if (E.cy > 0) {
+                E.cy--;
+                E.cx = get_line_length(E.cy);
+            }
+            break;
+        
+        case ARROW_RIGHT: {
+            size_t line_len = get_line_length(E.cy);
+            if (E.cx < line_len) {
+                E.cx++;
+            } else if (E.cy < total_rows - 1) {
+                E.cy++;
+                E.cx = 0;
+            }
+            break;
+        }
+        
+        case ARROW_UP:
+            if (E.cy > 0) {
+                E.cy--;
+                size_t line_len = get_line_length(E.cy);
+                if (E.cx > line_len) E.cx = line_len;
+            }
+            break;
+        
+        case ARROW_DOWN:
+            if (E.cy < total_rows - 1) {
+                E.cy++;
+                size_t line_len = get_line_length(E.cy);
+                if (E.cx > line_len) E.cx = line_len;
+            }
+            break;
+        
+        case HOME_KEY:
+            E.cx = 0;
+            break;
+        
+        case END_KEY:
+            E.cx = get_line_length(E.cy);
+            break;
+        
+        case PAGE_UP:
+            E.cy = E.rowoff;
+            for (int i = 0; i < E.screenrows - 2; i++) {
+                if (E.cy > 0) E.cy--;
+            }
+            break;
+        
+        case PAGE_DOWN:
+            E.cy = E.rowoff + E.screenrows - 2;
+            if (E.cy > total_rows - 1) E.cy = total_rows - 1;
+            for (int i = 0; i < E.screenrows - 2; i++) {
+                if (E.cy < total_rows - 1) E.cy++;
+            }
+            break;
+    }
+}
+
+/* -------- editor operations -------- */
+/* Delete the selected text and put the cursor where it began */
+void editorDeleteSelection(void) {
+    selection_delete(&E.sel, &g, &E.history);
+    pos_to_rowcol(&g, gap_cursor(&g), &E.cy, &E.cx);
+    E.dirty++;
+}
+
+void editorInsertChar(char c) {
+    size_t pos = rowcol_to_pos(&g, E.cy, E.cx);
+    gap_move(&g, pos);
+    gap_insert(&g, c);
+    history_push(&E.history, EDIT_INSERT, pos, c);
+    E.cx++;
+    E.dirty++;
+}
+
+void editorInsertNewline(void) {
+    size_t pos = rowcol_to_pos(&g, E.cy, E.cx);
+    gap_move(&g, pos);
+    history_begin(&E.history);
+    gap_insert(&g, '\n');
+    history_push(&E.history, EDIT_INSERT_NEWLINE, pos, '\n');
+    
+    int prev_indent = get_line_indent(E.cy);
+    E.cy++;
+    E.cx = 0;
+    
+    for (int i = 0; i < prev_indent; i++) {
+        gap_insert(&g, ' ');
+        history_push(&E.history, EDIT_INSERT, pos + 1 + i, ' ');
+        E.cx++;
+    }
+    history_end(&E.history);
+    
+    E.dirty++;
+}
+
+void editorDelChar(void) {
+    if (E.cx > 0) {
+        size_t pos = rowcol_to_pos(&g, E.cy, E.cx);
+        gap_move(&g, pos);
+        char ch = gap_char_at(&g, pos - 1);
+        if (gap_backspace(&g)) {
+            history_push(&E.history, EDIT_DELETE, pos - 1, ch);
+            E.cx--;
+            E.dirty++;
+        }
+    } else if (E.cy > 0) {
+        size_t prev_line_len = get_line_length(E.cy - 1);
+        size_t pos = rowcol_to_pos(&g, E.cy, 0);
+        gap_move(&g, pos);
+        if (gap_backspace(&g)) {
+            history_push(&E.history, EDIT_DELETE_NEWLINE, pos - 1, '\n');
+            E.cy--;
+            E.cx = prev_line_len;
+            E.dirty++;
+        }
+    }
+}
+
+/* -------- search -------- */
+/* Move to the match nearest pos in direction dir, wrapping around the
+ * end of the buffer, and show the query with the result */
+static void editorSearchStep(size_t pos, int dir) {
+    size_t len = gap_length(&g), n = E.search_len;
+    size_t hit = SEARCH_NONE, mend = SEARCH_NONE;
+    /* matches before pos: a literal one may run on past it */
+    size_t before = E.search_regex ? pos : pos + n - 1;
+    
+    E.search_direction = dir;
+    if (n && dir > 0) {
+        hit = editorFind(pos, len, 1, &mend);
+        if (hit == SEARCH_NONE) hit = editorFind(0, E.search_regex ? len : before, 1, &mend);
+    } else if (n) {
+        hit = editorFind(0, before, -1, &mend);
+        if (hit == SEARCH_NONE) hit = editorFind(pos, len, -1, &mend);
+    }
+    E.search_match_pos = hit;
+    E.search_match_end = mend;
+    if (hit != SEARCH_NONE) {
+        pos_to_rowcol(&g, hit, &E.cy, &E.cx);
+    }
+    
+    const char *result = "";
+    if (E.search_regex && n && !E.regex) result = E.regex_error;
+    else if (n && hit == SEARCH_NONE) result = "not found";
+    snprintf(E.statusmsg, sizeof(E.statusmsg), "%s: %.*s%s%s%s (Esc/Enter/Arrows/^R/Tab)",
+             E.search_regex ? "Regex" : "Search",
+             (int)(E.search_len > 40 ? 40 : E.search_len), E.search_query,
+             *result ? " [" : "", result, *result ? "]" : "");
+}
+
+/* Recompile after the query or the search mode changed */
+static void editorSearchUpdate(void) {
+    search_free(&E.search);
+    regex_free(E.regex);
+    E.regex = NULL;
+    if (E.search_regex) {
+        E.regex = regex_compile(E.search_query, E.search_len, &E.regex_error);
+    } else {
+        search_compile(&E.search, E.search_query, E.search_len);
+    }
+}
+
+void editorSearchStart(void) {
+    selection_clear(&E.sel);
+    E.searching = 1;
+    E.search_len = 0;
+    E.search_match_pos = SEARCH_NONE;
+    E.search_origin = rowcol_to_pos(&g, E.cy, E.cx);
+    E.search_cx = E.cx;
+    E.search_cy = E.cy;
+    E.search_rowoff = E.rowoff;
+    E.search_coloff = E.coloff;
+    editorSearchUpdate();
+    editorSearchStep(E.search_origin, 1);
+}
+
+static void editorReplacePrompt(void) {
+    snprintf(E.statusmsg, sizeof(E.statusmsg), "Replace %.*s with: %.*s (Enter replaces all, Esc)",
+             (int)(E.search_len > 30 ? 30 : E.search_len), E.search_query,
+             (int)(E.replace_len > 30 ? 30 : E.replace_len), E.replace_text ? E.replace_text : "");
+}
+
+/* Replace every match in one pass over the buffer, undone as one step */
+static void editorReplaceAll(void) {
+    size_t len = gap_length(&g), pos = 0, n = 0, cap = 0, hit, mend;
+    struct gapedit *edits = NULL;
+    while (pos <= len && (hit = editorFind(pos, len, 1, &mend)) != SEARCH_NONE) {
+        if (n == cap) {
+            cap = cap ? cap * 2 : 256;
+            edits = realloc(edits, sizeof(struct gapedit) * cap);
+        }
+        edits[n].pos = hit;
+        edits[n].len = mend - hit;
+        edits[n].text = E.replace_text;
+        edits[n].text_len = E.replace_len;
+        n++;
+        pos = mend > hit ? mend : hit + 1;
+    }
+    if (n == 0) {
+        snprintf(E.statusmsg, sizeof(E.statusmsg), "Nothing to replace");
+        return;
+    }
+    
+    history_push_replace(&E.history, &g, edits, n);
+    gap_splice(&g, edits, n);
+    free(edits);
+    E.dirty++;
+    
+    size_t lines = gap_lines_upto(&g, E.cy + 1);
+    if (E.cy >= lines) E.cy = lines - 1;
+    size_t line_len = gap_line_end(&g, E.cy) - gap_line_start(&g, E.cy);
+    if (E.cx > line_len) E.cx = line_len;
+    snprintf(E.statusmsg, sizeof(E.statusmsg), "Replaced %zu match%s", n, n == 1 ? "" : "es");
+}
+
+/* Typing builds the replacement; Enter replaces, Esc goes back to the
+ * search */
+static void editorReplaceKey(int key) {
+    switch (key) {
+        case '\r':
+            E.replacing = 0;
+            E.searching = 0;
+            editorReplaceAll();
+            break;
+        
+        case '\x1b':
+            E.replacing = 0;
+            editorSearchStep(E.search_match_pos != SEARCH_NONE ? E.search_match_pos : E.search_origin, 1);
+            break;
+        
+        case 127:
+        case '\x08':
+            if (E.replace_len > 0) E.replace_len--;
+            editorReplacePrompt();
+            break;
+        
+        default:
+            if (key >= 32 && key < 127) {
+                E.replace_text = realloc(E.replace_text, E.replace_len + 1);
+                E.replace_text[E.replace_len++] = (char)key;
+                editorReplacePrompt();
+            }
+            break;
+    }
+}
+
+/* Typing extends the query and searches on from the current match;
+ * arrows step between matches, Ctrl-R switches between literal and
+ * regex search, Tab asks for a replacement; Enter stays, Esc goes back */
+void editorSearchKey(int key) {
+    size_t from = E.search_match_pos != SEARCH_NONE ? E.search_match_pos : E.search_origin;
+    
+    if (E.replacing) {
+        editorReplaceKey(key);
+        return;
+    }
+    switch (key) {
+        case '\r':
+            E.searching = 0;
+            E.statusmsg[0] = '\0';
+            break;
+        
+        case '\x1b':
+            E.searching = 0;
+            E.cx = E.search_cx;
+            E.cy = E.search_cy;
+            E.rowoff = E.search_rowoff;
+            E.coloff = E.search_coloff;
+            E.statusmsg[0] = '\0';
+            break;
+        
+        case '\x06':
+        case ARROW_RIGHT:
+        case ARROW_DOWN:
+            /* regex matches do not overlap; literal ones may */
+            if (E.search_match_pos == SEARCH_NONE) editorSearchStep(from, 1);
+            else if (E.search_regex && E.search_match_end > from) editorSearchStep(E.search_match_end, 1);
+            else editorSearchStep(from + 1, 1);
+            break;
+        
+        case ARROW_LEFT:
+        case ARROW_UP:
+            editorSearchStep(from, -1);
+            break;
+        
+        case '\t':
+            /* grep results can be searched but not rewritten */
+            if (E.grep_view) break;
+            if (E.search_len > 0 && (!E.search_regex || E.regex)) {
+                E.replacing = 1;
+                E.replace_len = 0;
+                editorReplacePrompt();
+            }
+            break;
+        
+        case '\x12':
+            E.search_regex = !E.search_regex;
+            editorSearchUpdate();
+            editorSearchStep(E.search_origin, 1);
+            break;
+        
+        case 127:
+        case '\x08':
+            if (E.search_len > 0) {
+                E.search_len--;
+                editorSearchUpdate();
+            }
+            editorSearchStep(E.search_origin, 1);
+            break;
+        
+        default:
+            if (key >= 32 && key < 127) {
+                E.search_query = realloc(E.search_query, E.search_len + 1);
+                E.search_query[E.search_len++] = (char)key;
+                editorSearchUpdate();
+                editorSearchStep(from, 1);
+            }
+            break;
+    }
+}
+
+/* -------- project grep -------- */
+/* Open path at row, 1-based, leaving the grep results */
+static void editorGrepOpen(const char *path, size_t row) {
+    grep_stop(&E.grep);
+    E.grep_view = 0;
+    editorClose();
+    E.statusmsg[0] = '\0';
+    editorOpen(path);
+    
+    size_t lines = gap_lines_upto(&g, row);
+    E.cy = row > 0 && row <= lines ? row - 1 : lines - 1;
+    E.rowoff = E.cy > (size_t)E.screenrows / 2 ? E.cy - E.screenrows / 2 : 0;
+}
+
+/* Enter on a "path:line:text" result opens it */
+static void editorGrepJump(void) {
+    size_t start = gap_line_start(&g, E.cy), end = gap_line_end(&g, E.cy);
+    char *line = malloc(end - start + 1);
+    gap_copy_range(&g, start, end, line);
+    line[end - start] = '\0';
+    
+    /* the path may hold colons itself; the line number ends with one */
+    for (char *c = line; (c = strchr(c, ':')) != NULL; c++) {
+        char *num_end;
+        unsigned long row = strtoul(c + 1, &num_end, 10);
+        if (c[1] >= '0' && c[1] <= '9' && *num_end == ':') {
+            *c = '\0';
+            editorGrepOpen(line, row);
+            break;
+        }
+    }
+    free(line);
+}
+
+/* Esc on the results goes back to the file grep was started from */
+static void editorGrepBack(void) {
+    if (E.grep_origin) {
+        char *path = E.grep_origin;
+        E.grep_origin = NULL;
+        editorGrepOpen(path, E.grep_origin_row + 1);
+        free(path);
+        return;
+    }
+    grep_stop(&E.grep);
+    E.grep_view = 0;
+    editorClose();
+    E.statusmsg[0] = '\0';
+}
+
+/* Clear the buffer for results and start searching from the current
+ * directory; they are appended as editorIdle collects them */
+static void editorGrepStart(void) {
+    grep_stop(&E.grep);
+    if (!E.grep_view) {
+        free(E.grep_origin);
+        E.grep_origin = E.filename ? strdup(E.filename) : NULL;
+        E.grep_origin_row = E.cy;
+    }
+    editorClose();
+    E.grep_view = 1;
+    if (grep_start(&E.grep, ".", E.grep_query, E.grep_len) == -1) {
+        snprintf(E.statusmsg, sizeof(E.statusmsg), "Grep failed to start");
+        return;
+    }
+    snprintf(E.statusmsg, sizeof(E.statusmsg), "Grep: searching for %.*s...",
+             (int)(E.grep_len > 40 ? 40 : E.grep_len), E.grep_query);
+}
+
+/* Append the results found since the last call; returns 1 if the
+ * screen needs redrawing */
+static int editorPollGrep(void) {
+    const char *out;
+    size_t len;
+    int state = grep_poll(&E.grep, &out, &len);
+    if (state == GREP_IDLE) return 0;
+    if (len) {
+        gap_move(&g, gap_length(&g));
+        gap_insert_n(&g, out, len);
+    }
+    if (state == GREP_DONE) {
+        snprintf(E.statusmsg, sizeof(E.statusmsg), "%zu matches in %zu files (Enter opens, Esc goes back)",
+                 E.grep.matches, E.grep.files);
+        return 1;
+    }
+    snprintf(E.statusmsg, sizeof(E.statusmsg), "Grep: %zu matches in %zu files...",
+             E.grep.matches, E.grep.files);
+    return len > 0;
+}
+
+static void editorGrepPrompt(void) {
+    snprintf(E.statusmsg, sizeof(E.statusmsg), "Grep: %.*s (Enter searches the project, Esc)",
+             (int)(E.grep_len > 40 ? 40 : E.grep_len), E.grep_query ? E.grep_query : "");
+}
+
+/* Typing edits the query, which is kept for the next Ctrl-P */
+static void editorGrepPromptKey(int key) {
+    switch (key) {
+        case '\r':
+            E.grep_prompt = 0;
+            if (E.grep_len > 0) editorGrepStart();
+            else E.statusmsg[0] = '\0';
+            break;
+        
+        case '\x1b':
+            E.grep_prompt = 0;
+            E.statusmsg[0] = '\0';
+            break;
+        
+        case 127:
+        case '\x08':
+            if (E.grep_len > 0) E.grep_len--;
+            editorGrepPrompt();
+            break;
+        
+        default:
+            if (key >= 32 && key < 127) {
+                E.grep_query = realloc(E.grep_query, E.grep_len + 1);
+                E.grep_query[E.grep_len++] = (char)key;
+                editorGrepPrompt();
+            }
+            break;
+    }
+}
+
+/* The results are read-only: Enter and Esc leave them, and only keys
+ * that move, find, copy or quit do what they usually do. Returns 1 if
+ * the key was dealt with here. */
+static int editorGrepViewKey(int key) {
+    switch (key) {
+        case '\r':
+            editorGrepJump();
+            return 1;
+        
+        case '\x1b':
+            editorGrepBack();
+            return 1;
+        
+        case ARROW_UP:
+        case ARROW_DOWN:
+        case ARROW_LEFT:
+        case ARROW_RIGHT:
+        case PAGE_UP:
+        case PAGE_DOWN:
+        case HOME_KEY:
+        case END_KEY:
+        case '\x01':
+        case '\x03':
+        case '\x06':
+        case '\x10':
+        case '\x11':
+            return 0;
+        
+        default:
+            return 1;
+    }
+}
+
+/* -------- key handling -------- */
+int editorProcessKey(int c) {
+    if (E.show_welcome) {
+        E.show_welcome = 0;
+        E.statusmsg[0] = '\0';
+        return 0;
+    }
+    
+    int shift_pressed = is_shift_arrow(c);
+    int base_key = get_base_key(c);
+    
+    if (E.searching) {
+        editorSearchKey(base_key);
+        return 0;
+    }
+    if (E.grep_prompt) {
+        editorGrepPromptKey(base_key);
+        return 0;
+    }
+    if (E.grep_view && editorGrepViewKey(base_key)) return 0;
+    
+    switch (base_key) {
+        case '\x11':
+            if (editorSaveFinished(save_wait(&E.save, &g)) == SAVE_FAILED) {
+                snprintf(E.statusmsg, sizeof(E.statusmsg), "Save failed (%s): %s",
+                         E.save.failed, strerror(E.save.err));
+                break;
+            }
+            return 1;
+        
+        case '\x13':
+            editorSave();
+            break;
+        
+        case '\x1a':
+            if (history_undo(&E.history, &g)) {
+                pos_to_rowcol(&g, gap_cursor(&g), &E.cy, &E.cx);
+                E.dirty++;
+            } else if (E.history.truncated) {
+                snprintf(E.statusmsg, sizeof(E.statusmsg),
+                         "History truncated: older edits were dropped (history_limit)");
+            }
+            selection_clear(&E.sel);
+            break;
+        
+        case '\x19':
+            if (history_redo(&E.history, &g)) {
+                pos_to_rowcol(&g, gap_cursor(&g), &E.cy, &E.cx);
+                E.dirty++;
+            }
+            selection_clear(&E.sel);
+            break;
+        
+        case '\x03':
+            if (E.sel.active) {
+                clipboard_copy(&E.clip, &E.sel, &g);
+                snprintf(E.statusmsg, sizeof(E.statusmsg), "Copied %zu bytes", E.clip.len);
+                selection_clear(&E.sel);
+            }
+            break;
+        
+        case '\x16':
+            history_begin(&E.history);
+            if (E.sel.active) {
+                editorDeleteSelection();
+            }
+            if (E.clip.len) {
+                clipboard_paste(&E.clip, &g, rowcol_to_pos(&g, E.cy, E.cx), &E.history);
+                pos_to_rowcol(&g, gap_cursor(&g), &E.cy, &E.cx);
+                E.dirty++;
+            }
+            history_end(&E.history);
+            break;
+        
+        case '\x18':
+            if (E.sel.active) {
+                clipboard_copy(&E.clip, &E.sel, &g);
+                editorDeleteSelection();
+                snprintf(E.statusmsg, sizeof(E.statusmsg), "Cut %zu bytes", E.clip.len);
+            }
+            break;
+        
+        case '\x01':
+            selection_start(&E.sel, 0, 0);
+            E.cy = count_rows() - 1;
+            E.cx = get_line_length(E.cy);
+            selection_update(&E.sel, E.cy, E.cx);
+            snprintf(E.statusmsg, sizeof(E.statusmsg), "Selected all");
+            break;
+        
+        case '\x06':
+            editorSearchStart();
+            break;
+        
+        case '\x10':
+            if (!E.grep_view && E.dirty != E.saved) {
+                snprintf(E.statusmsg, sizeof(E.statusmsg), "Unsaved changes: save (Ctrl-S) before grep");
+                break;
+            }
+            E.grep_prompt = 1;
+            editorGrepPrompt();
+            break;
+        
+        case '\r':
+            history_begin(&E.history);
+            if (E.sel.active) {
+                editorDeleteSelection();
+            }
+            editorInsertNewline();
+            history_end(&E.history);
+            break;
+        
+        case 127:
+        case '\x08':
+            if (E.sel.active) {
+                editorDeleteSelection();
+            } else {
+                editorDelChar();
+            }
+            break;
+        
+        case DEL_KEY:
+            if (E.sel.active) {
+                editorDeleteSelection();
+            } else {
+                size_t pos = rowcol_to_pos(&g, E.cy, E.cx);
+                gap_move(&g, pos);
+                char ch = gap_char_at(&g, pos);
+                if (gap_delete(&g)) {
+                    history_push(&E.history, EDIT_DELETE, pos, ch);
+                    E.dirty++;
+                }
+            }
+            break;
+        
+        case '\t':
+            history_begin(&E.history);
+            if (E.sel.active) {
+                editorDeleteSelection();
+            }
+            for (int i = 0; i < TAB_STOP; i++) {
+                editorInsertChar(' ');
+            }
+            history_end(&E.history);
+            break;
+        
+        case ARROW_UP:
+        case ARROW_DOWN:
+        case ARROW_LEFT:
+        case ARROW_RIGHT:
+            if (shift_pressed) {
+                if (!E.sel.active) {
+                    selection_start(&E.sel, E.cy, E.cx);
+                }
+                editorMoveCursor(base_key);
+                selection_update(&E.sel, E.cy, E.cx);
+            } else {
+                if (E.sel.active) {
+                    selection_clear(&E.sel);
+                }
+                editorMoveCursor(base_key);
+            }
+            break;
+        
+        case HOME_KEY:
+        case END_KEY:
+            if (shift_pressed && !E.sel.active) {
+                selection_start(&E.sel, E.cy, E.cx);
+            }
+            editorMoveCursor(base_key);
+            if (shift_pressed) {
+                selection_update(&E.sel, E.cy, E.cx);
+            } else {
+                selection_clear(&E.sel);
+            }
+            break;
+        
+        case PAGE_UP:
+        case PAGE_DOWN:
+            if (shift_pressed && !E.sel.active) {
+                selection_start(&E.sel, E.cy, E.cx);
+            }
+            editorMoveCursor(base_key);
+            if (shift_pressed) {
+                selection_update(&E.sel, E.cy, E.cx);
+            } else {
+                selection_clear(&E.sel);
+            }
+            break;
+        
+        case '\x1b':
+            selection_clear(&E.sel);
+            E.statusmsg[0] = '\0';
+            break;
+        
+        default:
+            if (base_key >= 32 && base_key < 127) {
+                if (E.sel.active) {
+                    history_begin(&E.history);
+                    editorDeleteSelection();
+                    editorInsertChar((char)base_key);
+                    history_end(&E.history);
+                } else {
+                    editorInsertChar((char)base_key);
+                }
+            }
+            break;
+    }
+    return 0;
+}
+
+/* While a prompt is open the paste is typed into it, up to the first
+ * line break; otherwise it is inserted as it came, without auto-indent */
+void editorPaste(const char *text, size_t len) {
+    if (E.show_welcome) {
+        E.show_welcome = 0;
+        E.statusmsg[0] = '\0';
+    }
+    if (E.searching || E.grep_prompt) {
+        for (size_t i = 0; i < len && text[i] != '\r' && text[i] != '\n'; i++) {
+            if ((unsigned char)text[i] >= 32) editorProcessKey((unsigned char)text[i]);
+        }
+        return;
+    }
+    if (E.grep_view || len == 0) return;
+    
+    /* terminals send line breaks in a paste as \r */
+    char *buf = malloc(len);
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (text[i] != '\r') {
+            buf[n++] = text[i];
+        } else {
+            buf[n++] = '\n';
+            if (i + 1 < len && text[i + 1] == '\n') i++;
+        }
+    }
+    
+    history_begin(&E.history);
+    if (E.sel.active) {
+        editorDeleteSelection();
+    }
+    size_t pos = rowcol_to_pos(&g, E.cy, E.cx);
+    gap_move(&g, pos);
+    gap_insert_n(&g, buf, n);
+    history_push_n(&E.history, EDIT_INSERT, pos, buf, n);
+    history_end(&E.history);
+    pos_to_rowcol(&g, gap_cursor(&g), &E.cy, &E.cx);
+    E.dirty++;
+    free(buf);
+}
+
+/* -------- key-event API -------- */
+void editorInit(int rows, int cols) {
+    E.cx = E.cy = 0;
+    E.rowoff = E.coloff = 0;
+    E.filename = NULL;
+    E.lines_ready = 0;
+    E.dirty = E.saved = 0;
+    save_init(&E.save);
+    E.undo = NULL;
+    E.statusmsg[0] = '\0';
+    E.searching = 0;
+    E.search_query = NULL;
+    E.search_len = 0;
+    E.search_direction = 1;
+    E.search_match_pos = SEARCH_NONE;
+    E.search.text = E.search.window = NULL;
+    E.search_regex = 0;
+    E.regex = NULL;
+    E.replacing = 0;
+    E.replace_text = NULL;
+    E.replace_len = 0;
+    grep_init(&E.grep);
+    E.grep_prompt = E.grep_view = 0;
+    E.grep_query = NULL;
+    E.grep_len = 0;
+    E.grep_origin = NULL;
+    E.show_welcome = 1;
+    E.frame_bytes = 0;
+    config_default(&E.config);
+    config_load(&E.config, config_get_path());
+    
+    history_init(&E.history);
+    if (E.config.history_limit > 0) {
+        history_set_limit(&E.history, (size_t)E.config.history_limit << 20);
+    }
+    selection_clear(&E.sel);
+    syntax_init(&E.hl);
+    lang_load_dir(config_get_dir());
+    E.clip.data = NULL;
+    E.clip.len = 0;
+    
+    E.screenrows = rows - 2;
+    E.screencols = cols;
+    screen_invalidate();
+    
+    gap_init(&g, 1024);
+}
+
+void editorOpen(const char *filename) {
+    editorLoadFile(filename);
+    history_attach(&E.history, E.filename);
+    editorRecover();
+    E.show_welcome = 0;
+    if (!E.statusmsg[0]) {
+        snprintf(E.statusmsg, sizeof(E.statusmsg), 
+                 "Ctrl-S=save | Ctrl-Q=quit | Shift+Arrows=select | Ctrl-A=all | Esc=clear");
+    }
+}
+
+int editorIdle(void) {
+    int changed = editorPollSave();
+    if (editorPollGrep()) changed = 1;
+    if (editorPollLines()) changed = 1;
+    if (editorAutoSave()) changed = 1;
+    return changed;
+}
+
+void editorSetOutput(int fd) {
+    abufSetOutput(fd);
+    screen_invalidate();
+}
+
+void editorFree(void) {
+    grep_stop(&E.grep);
+    editorClose();
+    clipboard_free(&E.clip);
+    syntax_free(&E.hl);
+    lang_free_all();
+    gap_free(&g);
+    search_free(&E.search);
+    regex_free(E.regex);
+    E.regex = NULL;
+    free(E.search_query);
+    E.search_query = NULL;
+    free(E.replace_text);
+    E.replace_text = NULL;
+    free(E.grep_query);
+    free(E.grep_origin);
+    E.grep_query = E.grep_origin = NULL;
+}
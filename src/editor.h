@@ -0,0 +1,26 @@
+/* editor.h - Editor internals shared by the front end and benchmarks */
+#ifndef EDITOR_H
+#define EDITOR_H
+
+#include <stddef.h>
+#include "dira.h"
+
+/* Length of row, not counting its newline */
+size_t get_line_length(size_t row);
+
+/* Leading whitespace of row in columns */
+int get_line_indent(size_t row);
+
+/* Number of rows in the buffer */
+size_t count_rows(void);
+
+/* Start a background save of the buffer */
+void editorSave(void);
+
+/* Keep the cursor on screen */
+void editorScroll(void);
+
+/* Move the cursor for an unshifted movement key */
+void editorMoveCursor(int key);
+
+#endif /* EDITOR_H */
@@ -0,0 +1,326 @@
+/* grep.c - Parallel search of a directory tree */
+#define _POSIX_C_SOURCE 200809L
+
+#include "grep.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define GREP_MAX_WORKERS 64
+/* Longest piece of a matching line shown in the results */
+#define GREP_LINE_MAX 200
+/* A NUL this near the start marks a file as binary */
+#define GREP_BINARY_PROBE 8192
+
+struct grepDeque {
+    pthread_mutex_t lock;
+    char **paths;
+    size_t head;            /* thieves take from here */
+    size_t tail;            /* the owner pushes and pops here */
+    size_t cap;
+};
+
+struct grepWorker {
+    struct grepJob *job;
+    int id;
+    pthread_t thread;
+    struct grepDeque dq;
+    char *lines;            /* results of the file being searched */
+    size_t lines_len;
+    size_t lines_cap;
+};
+
+void grep_init(struct grepJob *job) {
+    job->workers = NULL;
+    job->nworkers = job->nthreads = 0;
+    job->running = 0;
+    job->pattern.text = job->pattern.window = NULL;
+    job->pattern.len = 0;
+    job->results = job->taken = NULL;
+    job->results_len = job->results_cap = job->taken_cap = 0;
+    job->matches = job->files = 0;
+}
+
+/* -------- work queue -------- */
+static void deque_push(struct grepWorker *w, char *path) {
+    struct grepDeque *dq = &w->dq;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail == dq->cap) {
+        if (dq->head > 0) {
+            memmove(dq->paths, dq->paths + dq->head, sizeof(char *) * (dq->tail - dq->head));
+            dq->tail -= dq->head;
+            dq->head = 0;
+        }
+        if (dq->tail == dq->cap) {
+            dq->cap = dq->cap ? dq->cap * 2 : 64;
+            dq->paths = realloc(dq->paths, sizeof(char *) * dq->cap);
+        }
+    }
+    dq->paths[dq->tail++] = path;
+    pthread_mutex_unlock(&dq->lock);
+    
+    struct grepJob *job = w->job;
+    pthread_mutex_lock(&job->lock);
+    job->queued++;
+    job->pending++;
+    pthread_cond_signal(&job->work);
+    pthread_mutex_unlock(&job->lock);
+}
+
+/* Take a path from the back of w's deque, or the front if stealing */
+static char *deque_take(struct grepWorker *w, int steal) {
+    struct grepDeque *dq = &w->dq;
+    char *path = NULL;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->head < dq->tail) {
+        path = steal ? dq->paths[dq->head++] : dq->paths[--dq->tail];
+        if (dq->head == dq->tail) dq->head = dq->tail = 0;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return path;
+}
+
+/* Next path for w, its own first, else stolen; NULL once the search is
+ * over. Waits while other workers may still turn up more paths. */
+static char *next_path(struct grepWorker *w) {
+    struct grepJob *job = w->job;
+    for (;;) {
+        char *path = deque_take(w, 0);
+        for (int i = 1; !path && i < job->nworkers; i++) {
+            path = deque_take(&job->workers[(w->id + i) % job->nworkers], 1);
+        }
+        
+        pthread_mutex_lock(&job->lock);
+        if (path) {
+            job->queued--;
+            pthread_mutex_unlock(&job->lock);
+            return path;
+        }
+        while (job->queued == 0 && job->pending > 0 && !job->stop) {
+            pthread_cond_wait(&job->work, &job->lock);
+        }
+        int over = job->pending == 0 || job->stop;
+        pthread_mutex_unlock(&job->lock);
+        if (over) return NULL;
+    }
+}
+
+static void path_done(struct grepJob *job) {
+    pthread_mutex_lock(&job->lock);
+    if (--job->pending == 0) pthread_cond_broadcast(&job->work);
+    pthread_mutex_unlock(&job->lock);
+}
+
+/* -------- searching -------- */
+static void add_line(struct grepWorker *w, const char *path, size_t lineno, const char *s, size_t n) {
+    if (n > GREP_LINE_MAX) n = GREP_LINE_MAX;
+    if (n > 0 && s[n - 1] == '\r') n--;
+    size_t need = strlen(path) + n + 32;
+    if (w->lines_len + need > w->lines_cap) {
+        w->lines_cap = (w->lines_len + need) * 2;
+        w->lines = realloc(w->lines, w->lines_cap);
+    }
+    w->lines_len += snprintf(w->lines + w->lines_len, need, "%s:%zu:%.*s\n", path, lineno, (int)n, s);
+}
+
+/* Report every line of text that holds a match, numbering lines by
+ * counting newlines only as far as the last match */
+static size_t scan_file(struct grepWorker *w, const char *path, const char *text, size_t len) {
+    const struct searchPattern *p = &w->job->pattern;
+    size_t pos = 0, counted = 0, lineno = 1, found = 0, hit;
+    while (pos < len && (hit = search_bytes(p, text + pos, len - pos)) != SEARCH_NONE) {
+        hit += pos;
+        const char *nl;
+        while ((nl = memchr(text + counted, '\n', hit - counted)) != NULL) {
+            counted = nl - text + 1;
+            lineno++;
+        }
+        const char *end = memchr(text + hit, '\n', len - hit);
+        size_t line_end = end ? (size_t)(end - text) : len;
+        add_line(w, path, lineno, text + counted, line_end - counted);
+        found++;
+        /* one result per line */
+        pos = line_end + 1;
+        if (w->job->stop) break;
+    }
+    return found;
+}
+
+static void search_file(struct grepWorker *w, const char *path, int fd, size_t len) {
+    if (len == 0) return;
+    char *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) return;
+    posix_madvise(map, len, POSIX_MADV_SEQUENTIAL);
+    
+    size_t found = 0;
+    if (!memchr(map, '\0', len < GREP_BINARY_PROBE ? len : GREP_BINARY_PROBE)) {
+        w->lines_len = 0;
+        found = scan_file(w, path, map, len);
+    }
+    munmap(map, len);
+    if (!found) return;
+    
+    struct grepJob *job = w->job;
+    pthread_mutex_lock(&job->out);
+    if (job->results_len + w->lines_len > job->results_cap) {
+        job->results_cap = (job->results_len + w->lines_len) * 2;
+        job->results = realloc(job->results, job->results_cap);
+    }
+    memcpy(job->results + job->results_len, w->lines, w->lines_len);
+    job->results_len += w->lines_len;
+    job->matches += found;
+    job->files++;
+    pthread_mutex_unlock(&job->out);
+}
+
+/* Queue the entries of a directory, "dir/name" or just "name" at "." */
+static void list_dir(struct grepWorker *w, const char *path, int fd) {
+    DIR *dir = fdopendir(fd);
+    if (!dir) {
+        close(fd);
+        return;
+    }
+    size_t plen = strcmp(path, ".") == 0 ? 0 : strlen(path);
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL && !w->job->stop) {
+        if (de->d_name[0] == '.') continue;
+        size_t size = plen + strlen(de->d_name) + 2;
+        char *child = malloc(size);
+        if (plen) snprintf(child, size, "%s/%s", path, de->d_name);
+        else snprintf(child, size, "%s", de->d_name);
+        deque_push(w, child);
+    }
+    closedir(dir);
+}
+
+static void search_path(struct grepWorker *w, const char *path) {
+    /* O_NOFOLLOW keeps symlink cycles out of the walk */
+    int fd = open(path, O_RDONLY | O_NOFOLLOW | O_NONBLOCK);
+    if (fd == -1) return;
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        list_dir(w, path, fd);
+        return;
+    }
+    if (S_ISREG(st.st_mode)) search_file(w, path, fd, st.st_size);
+    close(fd);
+}
+
+static void *grep_thread(void *arg) {
+    struct grepWorker *w = arg;
+    char *path;
+    while ((path = next_path(w)) != NULL) {
+        if (!w->job->stop) search_path(w, path);
+        free(path);
+        path_done(w->job);
+    }
+    return NULL;
+}
+
+/* -------- interface -------- */
+int grep_start(struct grepJob *job, const char *root, const char *text, size_t len) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int n = cores < 1 ? 1 : cores > GREP_MAX_WORKERS ? GREP_MAX_WORKERS : (int)cores;
+    
+    search_compile(&job->pattern, text, len);
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_mutex_init(&job->out, NULL);
+    pthread_cond_init(&job->work, NULL);
+    job->queued = job->pending = 0;
+    job->stop = 0;
+    job->results_len = 0;
+    job->matches = job->files = 0;
+    job->workers = calloc(n, sizeof(struct grepWorker));
+    job->nworkers = n;
+    for (int i = 0; i < n; i++) {
+        job->workers[i].job = job;
+        job->workers[i].id = i;
+        pthread_mutex_init(&job->workers[i].dq.lock, NULL);
+    }
+    deque_push(&job->workers[0], strdup(root));
+    
+    /* with fewer threads than deques the idle ones are still stolen
+     * from, though nothing but the first is ever pushed to then */
+    job->nthreads = 0;
+    while (job->nthreads < n &&
+           pthread_create(&job->workers[job->nthreads].thread, NULL, grep_thread,
+                          &job->workers[job->nthreads]) == 0) {
+        job->nthreads++;
+    }
+    job->running = 1;
+    if (job->nthreads == 0) {
+        grep_stop(job);
+        return -1;
+    }
+    return 0;
+}
+
+/* Join the workers and free the queues */
+static void grep_finish(struct grepJob *job) {
+    for (int i = 0; i < job->nthreads; i++) pthread_join(job->workers[i].thread, NULL);
+    for (int i = 0; i < job->nworkers; i++) {
+        struct grepWorker *w = &job->workers[i];
+        /* paths a cancelled search left queued */
+        for (size_t j = w->dq.head; j < w->dq.tail; j++) free(w->dq.paths[j]);
+        free(w->dq.paths);
+        free(w->lines);
+        pthread_mutex_destroy(&w->dq.lock);
+    }
+    free(job->workers);
+    job->workers = NULL;
+    job->nworkers = job->nthreads = 0;
+    search_free(&job->pattern);
+    pthread_mutex_destroy(&job->lock);
+    pthread_mutex_destroy(&job->out);
+    pthread_cond_destroy(&job->work);
+    job->running = 0;
+}
+
+int grep_poll(struct grepJob *job, const char **out, size_t *len) {
+    *out = NULL;
+    *len = 0;
+    if (!job->running) return GREP_IDLE;
+    
+    pthread_mutex_lock(&job->lock);
+    int done = job->pending == 0;
+    pthread_mutex_unlock(&job->lock);
+    
+    /* swap batches so workers never wait on the caller */
+    pthread_mutex_lock(&job->out);
+    char *batch = job->results;
+    size_t batch_cap = job->results_cap;
+    *len = job->results_len;
+    job->results = job->taken;
+    job->results_cap = job->taken_cap;
+    job->results_len = 0;
+    job->taken = batch;
+    job->taken_cap = batch_cap;
+    pthread_mutex_unlock(&job->out);
+    *out = job->taken;
+    
+    if (done) grep_finish(job);
+    return done ? GREP_DONE : GREP_RUNNING;
+}
+
+void grep_stop(struct grepJob *job) {
+    if (job->running) {
+        pthread_mutex_lock(&job->lock);
+        job->stop = 1;
+        pthread_cond_broadcast(&job->work);
+        pthread_mutex_unlock(&job->lock);
+        grep_finish(job);
+    }
+    free(job->results);
+    free(job->taken);
+    job->results = job->taken = NULL;
+    job->results_len = job->results_cap = job->taken_cap = 0;
+}
@@ -0,0 +1,58 @@
+/* grep.h - Parallel search of a directory tree */
+#ifndef GREP_H
+#define GREP_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include "search.h"
+
+enum grepState {
+    GREP_IDLE,
+    GREP_RUNNING,
+    GREP_DONE
+};
+
+struct grepWorker;
+
+/* Paths waiting to be searched: a directory is listed and its entries
+ * queued, a file is mapped and scanned. Each worker takes from the back
+ * of its own deque and, when that is empty, steals from the front of
+ * another's, so a large subtree found by one worker spreads to all. */
+struct grepJob {
+    struct searchPattern pattern;
+    struct grepWorker *workers; /* one deque each */
+    int nworkers;
+    int nthreads;               /* workers whose thread started */
+    int running;                /* workers exist; caller's side only */
+    pthread_mutex_t lock;       /* guards the counters below */
+    pthread_cond_t work;
+    size_t queued;              /* paths in deques */
+    size_t pending;             /* paths queued or being searched */
+    int stop;
+    pthread_mutex_t out;        /* guards the results */
+    char *results;              /* "path:line:text" lines not yet taken */
+    size_t results_len;
+    size_t results_cap;
+    char *taken;                /* the last batch handed to the caller */
+    size_t taken_cap;
+    size_t matches;
+    size_t files;               /* files with a match */
+};
+
+/* Initialize an idle job */
+void grep_init(struct grepJob *job);
+
+/* Search every file under root for text[0..len) on one thread per
+ * core. Hidden entries and symbolic links are skipped, and so are files
+ * that look binary. Returns -1 if no thread can be started. */
+int grep_start(struct grepJob *job, const char *root, const char *text, size_t len);
+
+/* Hand over the result lines found since the last call; *out stays
+ * valid until the next one. A finished search is joined and reported
+ * once as GREP_DONE before the job goes back to GREP_IDLE. */
+int grep_poll(struct grepJob *job, const char **out, size_t *len);
+
+/* Cancel a running search, wait for its workers and free the results */
+void grep_stop(struct grepJob *job);
+
+#endif /* GREP_H */
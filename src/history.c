@@ -1,91 +1,641 @@
 /* history.c - Undo/redo implementation */
+#define _POSIX_C_SOURCE 200809L
+
 #include "history.h"
 #include "buffer.h"
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define HIST_CHUNK (64 * 1024)
+
+/* Sidecar header: magic, version, the saved file's size and mtime, and
+ * the hash of its text. A varint record count and the records follow. */
+#define UNDO_MAGIC "DIRAUNDO"
+#define UNDO_VERSION 1
+#define UNDO_HEADER 33
+/* Record flags: the type in bits 0-1, backward, joined, then this for
+ * a replace-all, which has no room in the type bits */
+#define UNDO_REPLACE 0x10
+#define REC_ALIGN(n) (((n) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
 
 void history_init(struct editHistory *h) {
-    h->undoStack = NULL;
-    h->redoStack = NULL;
+    h->chunks = NULL;
+    h->first = NULL;
+    h->top = NULL;
     h->grouping = 0;
+    h->group_started = 0;
+    h->sealed = 0;
+    h->journal = NULL;
+    h->filename = NULL;
+    h->sidecar = NULL;
+    h->pending = 0;
+    h->bytes = 0;
+    h->limit = 0;
+    h->truncated = 0;
+}
+
+static int is_insert(enum editType type) {
+    return type == EDIT_INSERT || type == EDIT_INSERT_NEWLINE;
+}
+
+/* Arena bytes taken by a record holding len bytes */
+static size_t rec_size(size_t len) {
+    return REC_ALIGN(sizeof(struct edit) + len);
+}
+
+static char *chunk_data(struct histChunk *c) {
+    return (char *)(c + 1);
+}
+
+/* Start a new newest chunk with room for need bytes */
+static struct histChunk *chunk_push(struct editHistory *h, size_t need) {
+    size_t cap = need > HIST_CHUNK ? need : HIST_CHUNK;
+    struct histChunk *c = malloc(sizeof(struct histChunk) + cap);
+    c->prev = h->chunks;
+    c->used = 0;
+    c->cap = cap;
+    h->chunks = c;
+    h->bytes += sizeof(struct histChunk) + cap;
+    return c;
+}
+
+static void chunk_free(struct editHistory *h, struct histChunk *c) {
+    h->bytes -= sizeof(struct histChunk) + c->cap;
+    free(c);
+}
+
+/* Byte i of the run in document order */
+static char run_byte(const struct edit *e, size_t i) {
+    return e->backward ? e->text[e->len - 1 - i] : e->text[i];
+}
+
+/* -------- replace-all records -------- */
+static size_t put_varint(unsigned char *p, unsigned long long v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (unsigned char)v;
+    return n;
+}
+
+static int get_varint(const unsigned char **p, const unsigned char *end, unsigned long long *v) {
+    *v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (*p == end) return -1;
+        unsigned char b = *(*p)++;
+        *v |= (unsigned long long)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return 0;
+    }
+    return -1;
+}
+
+static size_t varint_len(unsigned long long v) {
+    size_t n = 1;
+    for (; v >= 0x80; v >>= 7) n++;
+    return n;
+}
+
+/* The edits a replace record makes, or with undo the edits taking it
+ * back, at positions in the text they apply to. Texts point into the
+ * record. */
+static struct gapedit *replace_edits(const struct edit *e, int undo, size_t *n) {
+    const unsigned char *p = (const unsigned char *)e->text;
+    const unsigned char *end = p + e->len;
+    unsigned long long count = 0, rlen = 0, gap, len;
+    if (get_varint(&p, end, &count) == -1 || get_varint(&p, end, &rlen) == -1 ||
+        rlen > (unsigned long long)(end - p)) {
+        count = rlen = 0;
+    }
+    const char *with = (const char *)p;
+    p += rlen;
+    /* each match takes at least two bytes */
+    if (count > e->len / 2) count = e->len / 2;
+    
+    struct gapedit *edits = malloc(sizeof(struct gapedit) * (count ? count : 1));
+    size_t old_end = 0, new_end = 0, i;
+    for (i = 0; i < count; i++) {
+        if (get_varint(&p, end, &gap) == -1 || get_varint(&p, end, &len) == -1 ||
+            len > (unsigned long long)(end - p)) {
+            break;
+        }
+        size_t at_old = old_end + gap, at_new = new_end + gap;
+        edits[i].pos = undo ? at_new : at_old;
+        edits[i].len = undo ? rlen : len;
+        edits[i].text = undo ? (const char *)p : with;
+        edits[i].text_len = undo ? len : rlen;
+        p += len;
+        old_end = at_old + len;
+        new_end = at_new + rlen;
+    }
+    *n = i;
+    return edits;
 }
 
-static void history_free_stack(struct edit *stack) {
-    while (stack) {
-        struct edit *next = stack->next;
-        free(stack);
-        stack = next;
+/* Journal a replace-all as the deletes and inserts it comes to when
+ * its edits are applied one at a time, left to right */
+static void replace_journal(struct editHistory *h, const struct edit *e, int undo) {
+    size_t n;
+    struct gapedit *edits = replace_edits(e, undo, &n);
+    struct gapedit *inverse = replace_edits(e, !undo, &n);
+    size_t added = 0, removed = 0;
+    for (size_t i = 0; i < n; i++) {
+        size_t at = edits[i].pos + added - removed;
+        journal_record_n(h->journal, JOURNAL_DELETE, at, inverse[i].text, edits[i].len);
+        journal_record_n(h->journal, JOURNAL_INSERT, at, edits[i].text, edits[i].text_len);
+        added += edits[i].text_len;
+        removed += edits[i].len;
+    }
+    free(edits);
+    free(inverse);
+}
+
+/* Journal what a run does to the buffer; undo journals the inverse */
+static void history_journal(struct editHistory *h, const struct edit *e, int undo) {
+    if (!h->journal) return;
+    if (e->type == EDIT_REPLACE) {
+        replace_journal(h, e, undo);
+        return;
+    }
+    int insert = is_insert(e->type) != undo;
+    if (!insert) {
+        journal_record_n(h->journal, JOURNAL_DELETE, e->pos, e->text, e->len);
+    } else if (!e->backward) {
+        journal_record_n(h->journal, JOURNAL_INSERT, e->pos, e->text, e->len);
+    } else {
+        /* a backward run holds its text last byte first */
+        char *text = malloc(e->len);
+        for (size_t i = 0; i < e->len; i++) text[i] = run_byte(e, i);
+        journal_record_n(h->journal, JOURNAL_INSERT, e->pos, text, e->len);
+        free(text);
     }
 }
 
 void history_free(struct editHistory *h) {
-    history_free_stack(h->undoStack);
-    history_free_stack(h->redoStack);
+    while (h->chunks) {
+        struct histChunk *prev = h->chunks->prev;
+        chunk_free(h, h->chunks);
+        h->chunks = prev;
+    }
+    h->first = NULL;
+    h->top = NULL;
+    h->truncated = 0;
+    free(h->filename);
+    free(h->sidecar);
+    h->filename = NULL;
+    h->sidecar = NULL;
+    h->pending = 0;
+}
+
+/* Drop the undone records after top, freeing whole chunks */
+static void history_truncate(struct editHistory *h) {
+    char *end = h->top ? (char *)h->top + rec_size(h->top->len) : NULL;
+    while (h->chunks) {
+        char *data = chunk_data(h->chunks);
+        if (end && end > data && end <= data + h->chunks->used) {
+            h->chunks->used = end - data;
+            break;
+        }
+        struct histChunk *prev = h->chunks->prev;
+        chunk_free(h, h->chunks);
+        h->chunks = prev;
+    }
+    if (h->top) h->top->next = NULL;
+    else h->first = NULL;
+}
+
+/* Make room for n more bytes in the top run, which is the last record.
+ * A run outgrowing its chunk moves to a chunk twice its size. */
+static struct edit *history_grow(struct editHistory *h, size_t n) {
+    struct edit *e = h->top;
+    struct histChunk *c = h->chunks;
+    size_t old = rec_size(e->len);
+    size_t size = rec_size(e->len + n);
+    if (size - old <= c->cap - c->used) {
+        c->used += size - old;
+        return e;
+    }
+    
+    if ((char *)e == chunk_data(c)) {
+        h->bytes += 2 * size - c->cap;
+        c = realloc(c, sizeof(struct histChunk) + 2 * size);
+        c->cap = 2 * size;
+        h->chunks = c;
+    } else {
+        c->used -= old;
+        c = chunk_push(h, 2 * size);
+        memcpy(chunk_data(c), e, old);
+    }
+    c->used = size;
+    e = (struct edit *)chunk_data(c);
+    if (e->prev) e->prev->next = e;
+    else h->first = e;
+    h->top = e;
+    return e;
+}
+
+void history_begin(struct editHistory *h) {
+    if (h->grouping++ == 0) {
+        h->group_started = 0;
+        h->sealed = 1;
+    }
+}
+
+void history_end(struct editHistory *h) {
+    if (h->grouping > 0 && --h->grouping == 0) h->sealed = 1;
+}
+
+/* Evict the oldest chunks while the history is over its limit. The
+ * chunk holding the last applied record always stays. */
+static void history_trim(struct editHistory *h) {
+    while (h->limit && h->bytes > h->limit && h->top) {
+        struct histChunk **link = &h->chunks;
+        while ((*link)->prev) link = &(*link)->prev;
+        struct histChunk *old = *link;
+        char *data = chunk_data(old);
+        if (old == h->chunks || ((char *)h->top >= data && (char *)h->top < data + old->used)) {
+            break;
+        }
+        
+        struct edit *last = NULL;
+        for (size_t off = 0; off < old->used; off += rec_size(last->len)) {
+            last = (struct edit *)(data + off);
+        }
+        if (last) {
+            /* undo stops here, even partway through a transaction */
+            h->first = last->next;
+            h->first->prev = NULL;
+            h->first->joined = 0;
+        }
+        *link = NULL;
+        chunk_free(h, old);
+        h->truncated = 1;
+        /* older sessions' history no longer joins on */
+        h->pending = 0;
+    }
+}
+
+void history_set_limit(struct editHistory *h, size_t limit) {
+    h->limit = limit;
+    history_trim(h);
+}
+
+size_t history_size(struct editHistory *h) {
+    return h->bytes;
 }
 
-void history_push(struct editHistory *h, enum editType type, int pos, char ch) {
-    struct edit *e = malloc(sizeof(struct edit));
+/* Add a record of n bytes after the top one; its text is left to fill */
+static struct edit *history_append(struct editHistory *h, enum editType type, size_t pos, size_t n,
+                                   int joined) {
+    size_t size = rec_size(n);
+    if (!h->chunks || h->chunks->cap - h->chunks->used < size) {
+        chunk_push(h, size);
+    }
+    struct edit *e = (struct edit *)(chunk_data(h->chunks) + h->chunks->used);
+    h->chunks->used += size;
     e->type = type;
     e->pos = pos;
-    e->ch = ch;
-    e->next = h->undoStack;
-    e->prev = NULL;
-    if (h->undoStack) h->undoStack->prev = e;
-    h->undoStack = e;
-    
-    history_free_stack(h->redoStack);
-    h->redoStack = NULL;
+    e->len = n;
+    e->backward = 0;
+    e->joined = joined;
+    e->next = NULL;
+    e->prev = h->top;
+    if (h->top) h->top->next = e;
+    else h->first = e;
+    h->top = e;
+    return e;
 }
 
-int history_undo(struct editHistory *h, struct gapbuf *g) {  // ✅ Added parameter
-    if (!h->undoStack) return 0;
+void history_push(struct editHistory *h, enum editType type, size_t pos, char ch) {
+    history_push_n(h, type, pos, &ch, 1);
+}
+
+void history_push_n(struct editHistory *h, enum editType type, size_t pos, const char *text, size_t n) {
+    if (n == 0) return;
+    if (h->journal) {
+        journal_record_n(h->journal, is_insert(type) ? JOURNAL_INSERT : JOURNAL_DELETE, pos, text, n);
+    }
+    history_truncate(h);
     
-    struct edit *e = h->undoStack;
-    h->undoStack = e->next;
-    if (h->undoStack) h->undoStack->prev = NULL;
+    /* typing extends an insert run; Delete and Backspace extend a delete
+     * run forwards and backwards */
+    struct edit *e = h->top;
+    int extend = 0, backward = 0;
+    if (e && e->type == type && !h->sealed) {
+        if (is_insert(type)) {
+            extend = pos == e->pos + e->len;
+        } else if (pos == e->pos && (e->len == 1 || !e->backward)) {
+            extend = 1;
+        } else if (n == 1 && pos + 1 == e->pos && (e->len == 1 || e->backward)) {
+            extend = backward = 1;
+        }
+    }
+    h->sealed = 0;
+    int joined = h->grouping > 0 && h->group_started;
+    if (h->grouping > 0) h->group_started = 1;
+    if (extend) {
+        e = history_grow(h, n);
+        memcpy(e->text + e->len, text, n);
+        e->len += n;
+        if (backward) {
+            e->backward = 1;
+            e->pos = pos;
+        }
+        history_trim(h);
+        return;
+    }
     
-    e->next = h->redoStack;
-    e->prev = NULL;
-    if (h->redoStack) h->redoStack->prev = e;
-    h->redoStack = e;
+    e = history_append(h, type, pos, n, joined);
+    memcpy(e->text, text, n);
+    history_trim(h);
+}
+
+void history_push_replace(struct editHistory *h, struct gapbuf *g, const struct gapedit *edits, size_t n) {
+    if (n == 0) return;
+    const char *with = edits[0].text;
+    size_t rlen = edits[0].text_len;
+    size_t size = varint_len(n) + varint_len(rlen) + rlen, end = 0;
+    for (size_t i = 0; i < n; i++) {
+        size += varint_len(edits[i].pos - end) + varint_len(edits[i].len) + edits[i].len;
+        end = edits[i].pos + edits[i].len;
+    }
+    history_truncate(h);
+    h->sealed = 0;
+    int joined = h->grouping > 0 && h->group_started;
+    if (h->grouping > 0) h->group_started = 1;
     
-    gap_move(g, e->pos);  // ✅ Now g is available
-    switch (e->type) {
-        case EDIT_INSERT:
-        case EDIT_INSERT_NEWLINE:
-            gap_delete(g);
-            break;
-        case EDIT_DELETE:
-        case EDIT_DELETE_NEWLINE:
-            gap_insert(g, e->ch);
-            break;
+    /* the matches are stored as the gap since the one before, so a
+     * short match costs a few bytes however large the buffer */
+    struct edit *e = history_append(h, EDIT_REPLACE, edits[0].pos, size, joined);
+    unsigned char *p = (unsigned char *)e->text;
+    p += put_varint(p, n);
+    p += put_varint(p, rlen);
+    if (rlen) memcpy(p, with, rlen);
+    p += rlen;
+    end = 0;
+    for (size_t i = 0; i < n; i++) {
+        p += put_varint(p, edits[i].pos - end);
+        p += put_varint(p, edits[i].len);
+        gap_copy_range(g, edits[i].pos, edits[i].pos + edits[i].len, (char *)p);
+        p += edits[i].len;
+        end = edits[i].pos + edits[i].len;
+    }
+    history_journal(h, e, 0);
+    history_trim(h);
+}
+
+/* Apply a run, or its inverse, to the buffer with one bulk operation */
+static void run_apply(struct edit *e, struct gapbuf *g, int undo) {
+    if (e->type == EDIT_REPLACE) {
+        size_t n;
+        struct gapedit *edits = replace_edits(e, undo, &n);
+        gap_splice(g, edits, n);
+        free(edits);
+        /* the first match is at the same place either way */
+        gap_move(g, e->pos);
+        return;
+    }
+    if (is_insert(e->type) == undo) {
+        gap_delete_range(g, e->pos, e->pos + e->len);
+        return;
+    }
+    gap_move(g, e->pos);
+    if (!e->backward) {
+        gap_insert_n(g, e->text, e->len);
+        /* leave the cursor where the first Delete was pressed */
+        if (undo) gap_move(g, e->pos);
+        return;
     }
+    char *text = malloc(e->len);
+    for (size_t i = 0; i < e->len; i++) text[i] = run_byte(e, i);
+    gap_insert_n(g, text, e->len);
+    free(text);
+}
+
+static void history_load(struct editHistory *h, struct gapbuf *g);
+
+int history_undo(struct editHistory *h, struct gapbuf *g) {  // ✅ Added parameter
+    /* the buffer is back at the session start: older history may follow */
+    if (!h->top && h->pending) history_load(h, g);
+    struct edit *e = h->top;
+    if (!e) return 0;
+    do {
+        e = h->top;
+        h->top = e->prev;
+        history_journal(h, e, 1);
+        run_apply(e, g, 1);  // ✅ Now g is available
+    } while (e->joined && h->top);
     
     return 1;
 }
 
 int history_redo(struct editHistory *h, struct gapbuf *g) {  // ✅ Added parameter
-    if (!h->redoStack) return 0;
+    struct edit *e = h->top ? h->top->next : h->first;
+    if (!e) return 0;
+    do {
+        h->top = e;
+        history_journal(h, e, 0);
+        run_apply(e, g, 0);  // ✅ Now g is available
+        e = e->next;
+    } while (e && e->joined);
     
-    struct edit *e = h->redoStack;
-    h->redoStack = e->next;
-    if (h->redoStack) h->redoStack->prev = NULL;
+    return 1;
+}
+
+/* -------- sidecar -------- */
+static void put64(unsigned char *p, unsigned long long v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static unsigned long long get64(const unsigned char *p) {
+    unsigned long long v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+/* Size and mtime of the file, as the header records them */
+static void file_stamp(const char *filename, unsigned char *stamp) {
+    struct stat st;
+    if (stat(filename, &st) == -1) memset(&st, 0, sizeof(st));
+    put64(stamp, st.st_size);
+    put64(stamp + 8, st.st_mtime);
+}
+
+void history_attach(struct editHistory *h, const char *filename) {
+    free(h->filename);
+    free(h->sidecar);
+    h->filename = strdup(filename);
+    const char *slash = strrchr(filename, '/');
+    int dirlen = slash ? (int)(slash - filename + 1) : 0;
+    size_t size = strlen(filename) + 8;
+    h->sidecar = malloc(size);
+    snprintf(h->sidecar, size, "%.*s.%s.undo", dirlen, filename, filename + dirlen);
+    h->pending = 0;
     
-    e->next = h->undoStack;
-    e->prev = NULL;
-    if (h->undoStack) h->undoStack->prev = e;
-    h->undoStack = e;
+    unsigned char header[UNDO_HEADER], stamp[16];
+    int fd = open(h->sidecar, O_RDONLY);
+    if (fd == -1) return;
+    file_stamp(filename, stamp);
+    if (read(fd, header, UNDO_HEADER) == UNDO_HEADER && memcmp(header, UNDO_MAGIC, 8) == 0 &&
+        header[8] == UNDO_VERSION && memcmp(header + 9, stamp, 16) == 0) {
+        h->pending = 1;
+    }
+    close(fd);
+}
+
+static unsigned char *read_file(const char *path, size_t *len) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return NULL;
+    struct stat st;
+    unsigned char *data = NULL;
+    if (fstat(fd, &st) == 0 && (data = malloc(st.st_size ? st.st_size : 1)) != NULL) {
+        size_t got = 0;
+        ssize_t n;
+        while (got < (size_t)st.st_size && (n = read(fd, data + got, st.st_size - got)) > 0) {
+            got += n;
+        }
+        *len = got;
+    }
+    close(fd);
+    return data;
+}
+
+/* Put the sidecar's records before this session's. With g given, the
+ * buffer must be at the session start and hash to what was saved. */
+static void history_load(struct editHistory *h, struct gapbuf *g) {
+    h->pending = 0;
+    size_t size;
+    unsigned char *data = read_file(h->sidecar, &size);
+    if (!data) return;
+    const unsigned char *p = data + UNDO_HEADER;
+    const unsigned char *end = data + size;
+    unsigned long long count, v, len;
+    if (size < UNDO_HEADER || memcmp(data, UNDO_MAGIC, 8) != 0 || data[8] != UNDO_VERSION ||
+        (g && get64(data + 25) != gap_hash(g)) || get_varint(&p, end, &count) == -1 || count == 0) {
+        free(data);
+        return;
+    }
     
-    gap_move(g, e->pos);  // ✅ Now g is available
-    switch (e->type) {
-        case EDIT_INSERT:
-        case EDIT_INSERT_NEWLINE:
-            gap_insert(g, e->ch);
-            break;
-        case EDIT_DELETE:
-        case EDIT_DELETE_NEWLINE:
-            gap_delete(g);
-            break;
+    /* check every record and size the arena before building anything */
+    const unsigned char *records = p;
+    size_t total = 0;
+    for (unsigned long long i = 0; i < count; i++) {
+        if (p == end || (*p++ & 0xe0) ||
+            get_varint(&p, end, &v) == -1 || get_varint(&p, end, &len) == -1 ||
+            len == 0 || len > (unsigned long long)(end - p)) {
+            free(data);
+            return;
+        }
+        p += len;
+        total += rec_size(len);
     }
     
-    return 1;
+    struct histChunk *c = malloc(sizeof(struct histChunk) + total);
+    c->prev = NULL;
+    c->used = c->cap = total;
+    h->bytes += sizeof(struct histChunk) + total;
+    struct edit *first = NULL, *prev = NULL;
+    size_t pos = 0, off = 0;
+    p = records;
+    for (unsigned long long i = 0; i < count; i++) {
+        unsigned char flags = *p++;
+        get_varint(&p, end, &v);
+        get_varint(&p, end, &len);
+        /* positions are zigzag deltas from the record before */
+        pos = v & 1 ? pos - (size_t)((v + 1) >> 1) : pos + (size_t)(v >> 1);
+        struct edit *e = (struct edit *)(chunk_data(c) + off);
+        off += rec_size(len);
+        e->type = flags & UNDO_REPLACE ? EDIT_REPLACE : (enum editType)(flags & 3);
+        e->backward = (flags >> 2) & 1;
+        e->joined = (flags >> 3) & 1;
+        e->pos = pos;
+        e->len = len;
+        memcpy(e->text, p, len);
+        p += len;
+        e->prev = prev;
+        e->next = NULL;
+        if (prev) prev->next = e;
+        else first = e;
+        prev = e;
+    }
+    free(data);
+    
+    /* the oldest chunk, holding the oldest records */
+    struct histChunk **oldest = &h->chunks;
+    while (*oldest) oldest = &(*oldest)->prev;
+    *oldest = c;
+    prev->next = h->first;
+    if (h->first) h->first->prev = prev;
+    h->first = first;
+    if (!h->top) h->top = prev;
+}
+
+char *history_serialize(struct editHistory *h, size_t *len) {
+    /* history from earlier sessions is carried into the new sidecar */
+    if (h->pending) history_load(h, NULL);
+    
+    unsigned long long count = 0;
+    size_t bound = 10;
+    for (struct edit *e = h->first; e && h->top; e = e->next) {
+        count++;
+        bound += 21 + e->len;
+        if (e == h->top) break;
+    }
+    
+    unsigned char *out = malloc(bound);
+    size_t n = put_varint(out, count);
+    size_t prev = 0;
+    for (struct edit *e = h->first; e && h->top; e = e->next) {
+        int type = e->type == EDIT_REPLACE ? UNDO_REPLACE : (int)e->type;
+        out[n++] = (unsigned char)(type | (e->backward << 2) | (e->joined << 3));
+        n += put_varint(out + n, e->pos >= prev ? (unsigned long long)(e->pos - prev) << 1
+                                                : ((unsigned long long)(prev - e->pos) << 1) - 1);
+        n += put_varint(out + n, e->len);
+        memcpy(out + n, e->text, e->len);
+        n += e->len;
+        prev = e->pos;
+        if (e == h->top) break;
+    }
+    *len = n;
+    return (char *)out;
+}
+
+static int write_all(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int history_store(struct editHistory *h, const char *data, size_t len, unsigned long long hash) {
+    if (!h->sidecar) return -1;
+    unsigned char header[UNDO_HEADER];
+    memcpy(header, UNDO_MAGIC, 8);
+    header[8] = UNDO_VERSION;
+    file_stamp(h->filename, header + 9);
+    put64(header + 25, hash);
+    
+    size_t tmp_size = strlen(h->sidecar) + 5;
+    char *tmp = malloc(tmp_size);
+    snprintf(tmp, tmp_size, "%s.new", h->sidecar);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    int ok = fd != -1 && write_all(fd, header, UNDO_HEADER) == 0 && write_all(fd, data, len) == 0;
+    if (fd != -1 && close(fd) == -1) ok = 0;
+    if (ok && rename(tmp, h->sidecar) == -1) ok = 0;
+    if (!ok && fd != -1) unlink(tmp);
+    free(tmp);
+    return ok ? 0 : -1;
 }
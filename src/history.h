@@ -3,26 +3,52 @@
 #define HISTORY_H
 
 #include "buffer.h"
+#include "journal.h"
 
 enum editType {
     EDIT_INSERT,
     EDIT_DELETE,
     EDIT_INSERT_NEWLINE,
-    EDIT_DELETE_NEWLINE
+    EDIT_DELETE_NEWLINE,
+    EDIT_REPLACE
 };
 
+/* One undo record: a run of same-type edits at adjacent positions.
+ * The run covers [pos, pos + len) of the document. An EDIT_REPLACE
+ * record instead holds a whole replace-all in text: the replacement
+ * once, then where each match was and the text it replaced. */
 struct edit {
-    enum editType type;
-    int pos;
-    char ch;
-    struct edit *next;
     struct edit *prev;
+    struct edit *next;
+    size_t pos;
+    size_t len;
+    enum editType type;
+    int backward;           /* a backspace run; text is in deletion order */
+    int joined;             /* undone and redone with the record before */
+    char text[];
+};
+
+/* Records are packed into arena chunks, newest chunk first */
+struct histChunk {
+    struct histChunk *prev;
+    size_t used;
+    size_t cap;
 };
 
 struct editHistory {
-    struct edit *undoStack;
-    struct edit *redoStack;
-    int grouping;
+    struct histChunk *chunks;
+    struct edit *first;     /* oldest record */
+    struct edit *top;       /* last applied record, NULL if all undone */
+    int grouping;           /* depth of open transactions */
+    int group_started;      /* the open transaction has a record */
+    int sealed;             /* the next push starts a new record */
+    struct journal *journal;    /* crash journal, when one is open */
+    char *filename;             /* file the history belongs to */
+    char *sidecar;              /* where it is kept between sessions */
+    int pending;                /* the sidecar has not been read yet */
+    size_t bytes;               /* memory held by the chunks */
+    size_t limit;               /* evict old records past this, 0 for none */
+    int truncated;              /* old records have been evicted */
 };
 
 /* Initialize history system */
@@ -31,13 +57,48 @@ void history_init(struct editHistory *h);
 /* Free all history */
 void history_free(struct editHistory *h);
 
-/* Push new edit to undo stack */
-void history_push(struct editHistory *h, enum editType type, int pos, char ch);
+/* Push new edit to undo stack, extending the top run when it can */
+void history_push(struct editHistory *h, enum editType type, size_t pos, char ch);
+
+/* Push an insert of text at pos, or a delete of the text that stood at
+ * pos, as one run */
+void history_push_n(struct editHistory *h, enum editType type, size_t pos, const char *text, size_t n);
+
+/* Record a replace-all before it is applied with gap_splice. The edits
+ * must all insert the same text; what they replace is read from g. */
+void history_push_replace(struct editHistory *h, struct gapbuf *g, const struct gapedit *edits, size_t n);
 
-/* Undo last edit */
+/* Cap the memory history may hold. Past the limit the oldest records
+ * are evicted and undo stops at the truncation point. */
+void history_set_limit(struct editHistory *h, size_t limit);
+
+/* Memory held by the history */
+size_t history_size(struct editHistory *h);
+
+/* Open a transaction: edits pushed until the matching history_end undo
+ * and redo as one unit. Transactions nest. */
+void history_begin(struct editHistory *h);
+
+/* Close a transaction */
+void history_end(struct editHistory *h);
+
+/* Undo the last run or transaction */
 int history_undo(struct editHistory *h, struct gapbuf *g);
 
-/* Redo last undone edit */
+/* Redo the last undone run or transaction */
 int history_redo(struct editHistory *h, struct gapbuf *g);
 
+/* Look for history saved by an earlier session in .<name>.undo beside
+ * filename. Only the header is read; the records are loaded the first
+ * time undo goes past the start of this session. */
+void history_attach(struct editHistory *h, const char *filename);
+
+/* Encode the applied history for history_store, at the moment the text
+ * being saved is snapshotted */
+char *history_serialize(struct editHistory *h, size_t *len);
+
+/* Write an encoded history to the sidecar once the save it was taken
+ * with has finished; hash is the gap_hash of the saved text */
+int history_store(struct editHistory *h, const char *data, size_t len, unsigned long long hash);
+
 #endif /* HISTORY_H */
@@ -0,0 +1,201 @@
+/* input.c - Terminal setup and keyboard input */
+#define _POSIX_C_SOURCE 200809L
+
+#include <termios.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+
+#include "input.h"
+#include "dira.h"
+
+/* Input is read in bulk into a ring, so a burst of keys or a paste
+ * takes one read rather than one per byte. A power of two. */
+#define INPUT_RING_SIZE 65536
+#define PASTE_END_LEN (sizeof(PASTE_END) - 1)
+
+/* -------- raw mode -------- */
+static struct termios orig_termios;
+
+void disableRawMode(void) { 
+    write(STDOUT_FILENO, "\x1b[?2004l", 8);
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios); 
+}
+
+void enableRawMode(void) {
+    if (tcgetattr(STDIN_FILENO, &orig_termios) == -1) exit(1);
+    atexit(disableRawMode);
+    struct termios raw = orig_termios;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_oflag &= ~(OPOST);
+    raw.c_cflag |= (CS8);
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 0; 
+    raw.c_cc[VTIME] = 1;
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+    /* have pastes bracketed, so they arrive as one edit */
+    write(STDOUT_FILENO, "\x1b[?2004h", 8);
+}
+
+/* -------- terminal size -------- */
+int getWindowSize(int *rows, int *cols) {
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1) return -1;
+    *cols = ws.ws_col; 
+    *rows = ws.ws_row; 
+    return 0;
+}
+
+/* -------- key decoding -------- */
+int editorDecodeKey(const char *s, size_t len, size_t *used) {
+    *used = 1;
+    if (s[0] != '\x1b') return s[0];
+    if (len < 3) {
+        *used = len;
+        return '\x1b';
+    }
+    *used = 3;
+    
+    if (s[1] == '[') {
+        if (s[2] >= '0' && s[2] <= '9') {
+            if (len >= 6 && memcmp(s, "\x1b[200~", 6) == 0) {
+                *used = 6;
+                return PASTE_START;
+            }
+            if (len < 4) return '\x1b';
+            *used = 4;
+            if (s[3] == '~') {
+                switch (s[2]) {
+                    case '1': return HOME_KEY;
+                    case '3': return DEL_KEY;
+                    case '4': return END_KEY;
+                    case '5': return PAGE_UP;
+                    case '6': return PAGE_DOWN;
+                    case '7': return HOME_KEY;
+                    case '8': return END_KEY;
+                }
+            }
+            else if (s[3] == 'A') return ARROW_UP | 0x1000;
+            else if (s[3] == 'B') return ARROW_DOWN | 0x1000;
+            else if (s[3] == 'C') return ARROW_RIGHT | 0x1000;
+            else if (s[3] == 'D') return ARROW_LEFT | 0x1000;
+        } else {
+            switch (s[2]) {
+                case 'A': return ARROW_UP;
+                case 'B': return ARROW_DOWN;
+                case 'C': return ARROW_RIGHT;
+                case 'D': return ARROW_LEFT;
+                case 'H': return HOME_KEY;
+                case 'F': return END_KEY;
+            }
+        }
+    } else if (s[1] == 'O') {
+        switch (s[2]) {
+            case 'H': return HOME_KEY;
+            case 'F': return END_KEY;
+        }
+    }
+    
+    return '\x1b';
+}
+
+size_t editorPasteEnd(const char *s, size_t len) {
+    const char *p = s, *end = s + len;
+    while ((p = memchr(p, '\x1b', end - p)) != NULL) {
+        if ((size_t)(end - p) < PASTE_END_LEN) break;
+        if (memcmp(p, PASTE_END, PASTE_END_LEN) == 0) return p - s;
+        p++;
+    }
+    return len;
+}
+
+/* -------- input ring -------- */
+static char ring[INPUT_RING_SIZE];
+static size_t ring_head;
+static size_t ring_len;
+
+/* Read whatever has arrived, waiting up to VTIME for it; returns the
+ * number of bytes read */
+static size_t ring_fill(void) {
+    size_t tail = (ring_head + ring_len) & (INPUT_RING_SIZE - 1);
+    size_t room = INPUT_RING_SIZE - ring_len;
+    if (tail + room > INPUT_RING_SIZE) room = INPUT_RING_SIZE - tail;
+    if (room == 0) return 0;
+    
+    ssize_t n = read(STDIN_FILENO, ring + tail, room);
+    if (n == -1 && errno != EAGAIN) exit(1);
+    if (n <= 0) return 0;
+    ring_len += n;
+    return n;
+}
+
+static char ring_at(size_t i) {
+    return ring[(ring_head + i) & (INPUT_RING_SIZE - 1)];
+}
+
+static void ring_drop(size_t n) {
+    ring_head = (ring_head + n) & (INPUT_RING_SIZE - 1);
+    ring_len -= n;
+}
+
+/* Bytes the key starting at seq[0..len) takes before it can be decoded */
+static size_t key_length(const char *seq, size_t len) {
+    if (seq[0] != '\x1b') return 1;
+    if (len < 3) return 3;
+    if (seq[1] != '[' || seq[2] < '0' || seq[2] > '9') return 3;
+    /* ESC[200~ starts a paste */
+    if (len >= 4 && seq[2] == '2' && seq[3] == '0') return 6;
+    return 4;
+}
+
+/* -------- input -------- */
+/* Wait for a key, doing background work while none arrives. An escape
+ * sequence is read only as far as it can be decoded. */
+int editorReadKey(void) {
+    char seq[6];
+    size_t len, used;
+    while (ring_len == 0) {
+        if (ring_fill() == 0 && editorIdle()) editorRefreshScreen();
+    }
+    
+    for (;;) {
+        len = ring_len < sizeof(seq) ? ring_len : sizeof(seq);
+        for (size_t i = 0; i < len; i++) seq[i] = ring_at(i);
+        if (len >= key_length(seq, len) || ring_fill() == 0) break;
+    }
+    int key = editorDecodeKey(seq, len, &used);
+    ring_drop(used);
+    return key;
+}
+
+/* Take the ring's contents a contiguous run at a time. If PASTE_END
+ * never comes, the paste ends when input stops. */
+const char *editorReadPaste(size_t *len) {
+    static char *paste = NULL;
+    static size_t paste_cap = 0;
+    size_t n = 0;
+    while (ring_len > 0 || ring_fill() > 0) {
+        size_t run = ring_len;
+        if (ring_head + run > INPUT_RING_SIZE) run = INPUT_RING_SIZE - ring_head;
+        if (n + run > paste_cap) {
+            paste_cap = (n + run) * 2;
+            paste = realloc(paste, paste_cap);
+        }
+        memcpy(paste + n, ring + ring_head, run);
+        
+        /* the marker may straddle two runs */
+        size_t from = n > PASTE_END_LEN - 1 ? n - (PASTE_END_LEN - 1) : 0;
+        size_t end = from + editorPasteEnd(paste + from, n + run - from);
+        if (end < n + run) {
+            ring_drop(end + PASTE_END_LEN - n);
+            n = end;
+            break;
+        }
+        ring_drop(run);
+        n += run;
+    }
+    *len = n;
+    return paste;
+}
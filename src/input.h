@@ -0,0 +1,23 @@
+/* input.h - Terminal setup and keyboard input */
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stddef.h>
+
+/* Put the terminal in raw mode; it is restored at exit */
+void enableRawMode(void);
+
+/* Restore the terminal mode saved by enableRawMode */
+void disableRawMode(void);
+
+/* Size of the terminal in rows and columns; -1 if unknown */
+int getWindowSize(int *rows, int *cols);
+
+/* Block until a key is pressed and return it decoded */
+int editorReadKey(void);
+
+/* After editorReadKey returns PASTE_START, read the pasted text up to
+ * PASTE_END. It stays valid until the next call. */
+const char *editorReadPaste(size_t *len);
+
+#endif /* INPUT_H */
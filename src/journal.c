@@ -0,0 +1,293 @@
+/* journal.c - Crash-recovery journal implementation */
+#define _POSIX_C_SOURCE 200809L
+
+#include "journal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define JOURNAL_MAGIC "DIRAJNL2"
+/* magic, then the saved file's size and mtime */
+#define HEADER_SIZE 24
+/* op, 8-byte position, 8-byte length; an insert's text follows */
+#define RECORD_HEADER 17
+#define JOURNAL_SYNC_SECS 1
+
+static void put64(unsigned char *p, unsigned long long v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static unsigned long long get64(const unsigned char *p) {
+    unsigned long long v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+/* "dir/name" is journaled in "dir/.name.journal" */
+static char *journal_path(const char *filename) {
+    const char *slash = strrchr(filename, '/');
+    int dirlen = slash ? (int)(slash - filename + 1) : 0;
+    size_t size = strlen(filename) + 11;
+    char *path = malloc(size);
+    snprintf(path, size, "%.*s.%s.journal", dirlen, filename, filename + dirlen);
+    return path;
+}
+
+/* Header describing the file st was taken of */
+static void stat_stamp(const struct stat *st, unsigned char *header) {
+    memcpy(header, JOURNAL_MAGIC, 8);
+    put64(header + 8, st->st_size);
+    put64(header + 16, st->st_mtime);
+}
+
+/* Header describing the file as it is on disk now */
+static void file_stamp(const char *filename, unsigned char *header) {
+    struct stat st;
+    if (stat(filename, &st) == -1) memset(&st, 0, sizeof(st));
+    stat_stamp(&st, header);
+}
+
+static int write_all(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Read back a journal that matches the file and apply its runs.
+ * Returns the number applied and sets *end past the last of them, or
+ * returns -1 if the journal does not apply. */
+static long replay(int fd, const char *filename, journalApply apply, void *arg, size_t *end) {
+    unsigned char stamp[HEADER_SIZE];
+    struct stat jst, fst;
+    file_stamp(filename, stamp);
+    if (fstat(fd, &jst) == -1 || (size_t)jst.st_size < HEADER_SIZE) return -1;
+    if (stat(filename, &fst) == 0 && jst.st_mtime < fst.st_mtime) return -1;
+    
+    size_t len = jst.st_size;
+    const unsigned char *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) return -1;
+    if (memcmp(map, stamp, HEADER_SIZE) != 0) {
+        munmap((void *)map, len);
+        return -1;
+    }
+    
+    long applied = 0;
+    size_t off = HEADER_SIZE;
+    while (len - off >= RECORD_HEADER) {
+        const unsigned char *r = map + off;
+        size_t pos = get64(r + 1), n = get64(r + 9);
+        const char *text = NULL;
+        size_t size = RECORD_HEADER;
+        if (r[0] == JOURNAL_INSERT) {
+            /* a torn record at the end */
+            if (n > len - off - RECORD_HEADER) break;
+            text = (const char *)r + RECORD_HEADER;
+            size += n;
+        }
+        if (apply(arg, r[0], pos, text, n) == -1) break;
+        applied++;
+        off += size;
+    }
+    munmap((void *)map, len);
+    *end = off;
+    return applied;
+}
+
+/* Move the current batch to the file and fsync it */
+static void journal_flush(struct journal *j) {
+    pthread_mutex_lock(&j->lock);
+    char *data = j->batch;
+    size_t len = j->batch_len;
+    size_t cap = j->batch_cap;
+    j->batch = j->spare;
+    j->batch_cap = j->spare_cap;
+    j->batch_len = 0;
+    pthread_mutex_unlock(&j->lock);
+    
+    if (len > 0 && write_all(j->fd, data, len) == 0) {
+        j->size += len;
+        fsync(j->fd);
+    }
+    j->spare = data;
+    j->spare_cap = cap;
+}
+
+/* Replace the file with one stamped for the saved file st that holds
+ * only the records from position mark on. The batch must have been
+ * flushed past mark. */
+static void journal_compact(struct journal *j, size_t mark, const struct stat *st) {
+    /* a later rebase has already dropped more */
+    if (mark < j->base) return;
+    size_t from = HEADER_SIZE + (mark - j->base);
+    size_t keep = j->size > from ? j->size - from : 0;
+    unsigned char *data = malloc(HEADER_SIZE + keep);
+    stat_stamp(st, data);
+    if (keep && pread(j->fd, data + HEADER_SIZE, keep, from) != (ssize_t)keep) keep = 0;
+    
+    size_t tmp_size = strlen(j->path) + 5;
+    char *tmp = malloc(tmp_size);
+    snprintf(tmp, tmp_size, "%s.new", j->path);
+    int fd = open(tmp, O_RDWR | O_APPEND | O_CREAT | O_TRUNC, 0600);
+    if (fd != -1 && write_all(fd, data, HEADER_SIZE + keep) == 0 && fsync(fd) == 0 &&
+        rename(tmp, j->path) == 0) {
+        close(j->fd);
+        j->fd = fd;
+        j->size = HEADER_SIZE + keep;
+        j->base = mark;
+    } else if (fd != -1) {
+        close(fd);
+        unlink(tmp);
+    }
+    free(tmp);
+    free(data);
+}
+
+static void *journal_thread(void *arg) {
+    struct journal *j = arg;
+    for (;;) {
+        pthread_mutex_lock(&j->lock);
+        if (!j->stop && !j->rebase_pending) {
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_sec += JOURNAL_SYNC_SECS;
+            pthread_cond_timedwait(&j->wake, &j->lock, &until);
+        }
+        int stop = j->stop;
+        int rebase = j->rebase_pending;
+        size_t mark = j->rebase;
+        struct stat st = j->rebase_st;
+        j->rebase_pending = 0;
+        pthread_mutex_unlock(&j->lock);
+        
+        /* the mark was taken before this flush, so it is in the file */
+        journal_flush(j);
+        if (stop) break;
+        if (rebase) journal_compact(j, mark, &st);
+    }
+    return NULL;
+}
+
+size_t journal_open(struct journal *j, const char *filename, journalApply apply, void *arg) {
+    j->enabled = 0;
+    j->filename = strdup(filename);
+    j->path = journal_path(filename);
+    long replayed = -1;
+    
+    j->fd = open(j->path, O_RDWR | O_APPEND);
+    if (j->fd != -1) {
+        replayed = replay(j->fd, filename, apply, arg, &j->size);
+        if (replayed >= 0) {
+            /* drop a torn record at the end, if any */
+            if (ftruncate(j->fd, j->size) == -1) replayed = -1;
+        }
+        if (replayed < 0) close(j->fd);
+    }
+    if (replayed < 0) {
+        unsigned char header[HEADER_SIZE];
+        file_stamp(filename, header);
+        j->fd = open(j->path, O_RDWR | O_APPEND | O_CREAT | O_TRUNC, 0600);
+        if (j->fd == -1) return 0;
+        if (write_all(j->fd, header, HEADER_SIZE) == -1) {
+            close(j->fd);
+            unlink(j->path);
+            return 0;
+        }
+        j->size = HEADER_SIZE;
+        replayed = 0;
+    }
+    
+    j->batch_cap = j->spare_cap = 4096;
+    j->batch = malloc(j->batch_cap);
+    j->spare = malloc(j->spare_cap);
+    j->batch_len = 0;
+    /* positions start out as offsets in the file */
+    j->base = j->rebase = HEADER_SIZE;
+    j->total = j->size;
+    j->rebase_pending = 0;
+    j->stop = 0;
+    pthread_mutex_init(&j->lock, NULL);
+    pthread_cond_init(&j->wake, NULL);
+    if (pthread_create(&j->thread, NULL, journal_thread, j) != 0) {
+        close(j->fd);
+        free(j->batch);
+        free(j->spare);
+        return replayed;
+    }
+    j->enabled = 1;
+    return replayed;
+}
+
+void journal_record_n(struct journal *j, int op, size_t pos, const char *s, size_t n) {
+    if (!j->enabled || n == 0) return;
+    size_t size = RECORD_HEADER + (op == JOURNAL_INSERT ? n : 0);
+    pthread_mutex_lock(&j->lock);
+    if (j->batch_len + size > j->batch_cap) {
+        while (j->batch_len + size > j->batch_cap) j->batch_cap *= 2;
+        j->batch = realloc(j->batch, j->batch_cap);
+    }
+    unsigned char *r = (unsigned char *)j->batch + j->batch_len;
+    r[0] = (unsigned char)op;
+    put64(r + 1, pos);
+    put64(r + 9, n);
+    if (op == JOURNAL_INSERT) memcpy(r + RECORD_HEADER, s, n);
+    j->batch_len += size;
+    j->total += size;
+    pthread_mutex_unlock(&j->lock);
+}
+
+size_t journal_size(struct journal *j) {
+    if (!j->enabled) return 0;
+    pthread_mutex_lock(&j->lock);
+    size_t size = j->total;
+    pthread_mutex_unlock(&j->lock);
+    return size;
+}
+
+size_t journal_unsaved(struct journal *j) {
+    if (!j->enabled) return 0;
+    pthread_mutex_lock(&j->lock);
+    size_t size = j->total - j->rebase;
+    pthread_mutex_unlock(&j->lock);
+    return size;
+}
+
+void journal_rebase(struct journal *j, size_t mark, const struct stat *st) {
+    if (!j->enabled) return;
+    pthread_mutex_lock(&j->lock);
+    j->rebase_pending = 1;
+    j->rebase = mark;
+    j->rebase_st = *st;
+    pthread_cond_signal(&j->wake);
+    pthread_mutex_unlock(&j->lock);
+}
+
+void journal_close(struct journal *j) {
+    if (!j->enabled) return;
+    pthread_mutex_lock(&j->lock);
+    j->stop = 1;
+    pthread_cond_signal(&j->wake);
+    pthread_mutex_unlock(&j->lock);
+    pthread_join(j->thread, NULL);
+    
+    close(j->fd);
+    unlink(j->path);
+    free(j->batch);
+    free(j->spare);
+    free(j->path);
+    free(j->filename);
+    j->enabled = 0;
+}
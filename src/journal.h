@@ -0,0 +1,72 @@
+/* journal.h - Crash-recovery journal of buffer edits */
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define JOURNAL_INSERT 1
+#define JOURNAL_DELETE 2
+
+/* Edits are appended to an in-memory batch on the keystroke path; a
+ * writer thread moves the batch to a sidecar file and fsyncs it on a
+ * timer. The file starts with the size and mtime of the saved file it
+ * applies to, so a stale journal is never replayed. Each record holds
+ * one run: an insert with its text, or a delete by length.
+ *
+ * Positions count every byte journaled since the journal was opened, so
+ * a mark stays valid however the file is compacted. Rebasing after a
+ * save is queued for the writer, which also does all the file I/O. */
+struct journal {
+    int enabled;
+    char *filename;         /* the file being edited */
+    char *path;             /* its journal */
+    int fd;                 /* writer's side, as are size and base */
+    pthread_t thread;
+    pthread_mutex_t lock;   /* guards the batch, total, the queued
+                             * rebase and stop */
+    pthread_cond_t wake;
+    char *batch;            /* edits not yet written */
+    size_t batch_len;
+    size_t batch_cap;
+    char *spare;            /* the previous batch, reused */
+    size_t spare_cap;
+    size_t size;            /* bytes in the file */
+    size_t base;            /* position of the file's first record */
+    size_t total;           /* position of the end, written or not */
+    int rebase_pending;
+    size_t rebase;          /* position the last rebase keeps from */
+    struct stat rebase_st;  /* the saved file it applies to */
+    int stop;
+};
+
+/* Called for each run found in a journal being replayed: an insert of
+ * text[0..len) at pos, or a delete of len bytes there (text is NULL) */
+typedef int (*journalApply)(void *arg, int op, size_t pos, const char *text, size_t len);
+
+/* Start journaling edits to filename. A journal left behind by a crash
+ * that still matches the file is first replayed through apply and then
+ * kept. Returns the number of runs replayed. */
+size_t journal_open(struct journal *j, const char *filename, journalApply apply, void *arg);
+
+/* Queue an insert of s at pos, or a delete of n bytes at pos, as one
+ * record; never blocks on I/O */
+void journal_record_n(struct journal *j, int op, size_t pos, const char *s, size_t n);
+
+/* Position of the end of the journal, written or not; never waits for
+ * the writer */
+size_t journal_size(struct journal *j);
+
+/* Bytes journaled after the position the last rebase keeps from */
+size_t journal_unsaved(struct journal *j);
+
+/* After the buffer as it stood at journal_size() == mark has been saved
+ * to the file described by st, have the writer drop the journal before
+ * mark and restart it from there; never blocks on I/O */
+void journal_rebase(struct journal *j, size_t mark, const struct stat *st);
+
+/* Stop the writer and delete the journal */
+void journal_close(struct journal *j);
+
+#endif /* JOURNAL_H */
@@ -0,0 +1,350 @@
+/* lang.c - Language definitions compiled to DFA lexers */
+#define _POSIX_C_SOURCE 200809L
+
+#include "lang.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+
+#define LANG_MAX_STATES 32767
+#define LANG_MAX_WORDS 512
+
+/* Used when no definition files can be found */
+static const char builtin_c[] =
+    "name = C\n"
+    "extensions = .c .h .cpp .cc\n"
+    "keywords = if else while for do return break continue switch case default "
+    "goto sizeof typedef struct union enum static const extern volatile inline\n"
+    "types = int char void short long float double signed unsigned\n"
+    "line_comment = //\n"
+    "block_comment = /* */\n"
+    "strings = \" '\n"
+    "escape = \\\n"
+    "numbers = yes\n";
+
+static struct language *languages = NULL;
+
+/* -------- definition parsing -------- */
+struct langDef {
+    char name[32];
+    char *words[LANG_MAX_WORDS];    /* owned copies of every token */
+    int nwords;
+    char **patterns;
+    int npatterns;
+    char *keywords[LANG_MAX_WORDS];
+    int nkeywords;
+    char *types[LANG_MAX_WORDS];
+    int ntypes;
+    char *line_comments[8];
+    int nline_comments;
+    char *block_start;
+    char *block_end;
+    char quotes[LANG_MAX_QUOTES + 1];
+    char multiline[LANG_MAX_QUOTES + 1];
+    char escape;
+    int numbers;
+};
+
+/* Split value into whitespace-separated tokens appended to list */
+static int split_words(struct langDef *d, char *value, char **list, int max) {
+    int n = 0;
+    for (char *tok = strtok(value, " \t"); tok && n < max; tok = strtok(NULL, " \t")) {
+        if (d->nwords == LANG_MAX_WORDS) break;
+        list[n] = d->words[d->nwords++] = strdup(tok);
+        n++;
+    }
+    return n;
+}
+
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s)) s++;
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) *--end = '\0';
+    return s;
+}
+
+static void parse_line(struct langDef *d, char *line) {
+    char *eq = strchr(line, '=');
+    if (!eq) return;
+    *eq = '\0';
+    char *key = trim(line);
+    char *value = trim(eq + 1);
+    char *pair[2];
+    
+    if (strcmp(key, "name") == 0) {
+        snprintf(d->name, sizeof(d->name), "%s", value);
+    } else if (strcmp(key, "extensions") == 0) {
+        d->patterns = realloc(d->patterns, sizeof(char *) * LANG_MAX_WORDS);
+        d->npatterns = split_words(d, value, d->patterns, LANG_MAX_WORDS);
+    } else if (strcmp(key, "keywords") == 0) {
+        d->nkeywords += split_words(d, value, d->keywords + d->nkeywords,
+                                    LANG_MAX_WORDS - d->nkeywords);
+    } else if (strcmp(key, "types") == 0) {
+        d->ntypes += split_words(d, value, d->types + d->ntypes,
+                                 LANG_MAX_WORDS - d->ntypes);
+    } else if (strcmp(key, "line_comment") == 0) {
+        d->nline_comments += split_words(d, value, d->line_comments + d->nline_comments,
+                                         8 - d->nline_comments);
+    } else if (strcmp(key, "block_comment") == 0) {
+        if (split_words(d, value, pair, 2) == 2 && strlen(pair[1]) < 8) {
+            d->block_start = pair[0];
+            d->block_end = pair[1];
+        }
+    } else if (strcmp(key, "strings") == 0 || strcmp(key, "multiline_strings") == 0) {
+        int multi = key[0] == 'm';
+        for (char *p = value; *p; p++) {
+            int n = strlen(d->quotes);
+            if (isspace((unsigned char)*p) || strchr(d->quotes, *p) || n == LANG_MAX_QUOTES) continue;
+            d->quotes[n] = *p;
+            d->multiline[n] = multi;
+        }
+    } else if (strcmp(key, "escape") == 0) {
+        d->escape = value[0];
+    } else if (strcmp(key, "numbers") == 0) {
+        d->numbers = strcmp(value, "yes") == 0 || strcmp(value, "on") == 0;
+    }
+}
+
+/* -------- DFA construction -------- */
+/* States are built with a full 256-way row each, then columns with
+ * identical transitions are merged into byte classes. */
+#define ST_START 0
+#define ST_IDENT 1
+#define ST_NUMBER 2
+
+struct dfaBuild {
+    short *next;
+    unsigned char *accept;
+    int nstates;
+    int cap;
+};
+
+static int is_word(int c) {
+    return isalnum(c) || c == '_';
+}
+
+static int priority(int kind) {
+    if (kind >= TOK_LINE_COMMENT) return 3;
+    if (kind == TOK_KEYWORD || kind == TOK_TYPE) return 2;
+    return kind != TOK_NONE;
+}
+
+static int new_state(struct dfaBuild *b, int ident_fallback) {
+    if (b->nstates == LANG_MAX_STATES) return -1;
+    if (b->nstates == b->cap) {
+        b->cap = b->cap ? b->cap * 2 : 64;
+        b->next = realloc(b->next, sizeof(short) * 256 * b->cap);
+        b->accept = realloc(b->accept, b->cap);
+    }
+    int st = b->nstates++;
+    for (int c = 0; c < 256; c++) {
+        b->next[st * 256 + c] = (ident_fallback && is_word(c)) ? ST_IDENT : -1;
+    }
+    b->accept[st] = ident_fallback ? TOK_IDENT : TOK_NONE;
+    return st;
+}
+
+/* Add a literal token, sharing prefixes with existing ones */
+static int add_literal(struct dfaBuild *b, const char *lit, int kind) {
+    int st = ST_START;
+    int wordy = !isdigit((unsigned char)lit[0]);
+    for (const unsigned char *p = (const unsigned char *)lit; *p; p++) {
+        wordy = wordy && is_word(*p);
+        int nx = b->next[st * 256 + *p];
+        if (nx < 0 || nx == ST_IDENT || nx == ST_NUMBER) {
+            nx = new_state(b, wordy);
+            if (nx < 0) return -1;
+            b->next[st * 256 + *p] = nx;
+        }
+        st = nx;
+    }
+    if (priority(kind) > priority(b->accept[st])) b->accept[st] = kind;
+    return 0;
+}
+
+static int compile_dfa(struct language *lang, struct langDef *d) {
+    struct dfaBuild b = { NULL, NULL, 0, 0 };
+    int ok = 1;
+    
+    new_state(&b, 0);                   /* ST_START */
+    new_state(&b, 1);                   /* ST_IDENT */
+    new_state(&b, 0);                   /* ST_NUMBER */
+    for (int c = 0; c < 256; c++) {
+        if (is_word(c)) b.next[ST_START * 256 + c] = ST_IDENT;
+        if (d->numbers && (is_word(c) || c == '.')) b.next[ST_NUMBER * 256 + c] = ST_NUMBER;
+    }
+    if (d->numbers) {
+        for (int c = '0'; c <= '9'; c++) b.next[ST_START * 256 + c] = ST_NUMBER;
+        b.accept[ST_NUMBER] = TOK_NUMBER;
+    }
+    
+    for (int i = 0; i < d->nkeywords; i++) ok = ok && add_literal(&b, d->keywords[i], TOK_KEYWORD) == 0;
+    for (int i = 0; i < d->ntypes; i++) ok = ok && add_literal(&b, d->types[i], TOK_TYPE) == 0;
+    for (int i = 0; i < d->nline_comments; i++) {
+        ok = ok && add_literal(&b, d->line_comments[i], TOK_LINE_COMMENT) == 0;
+    }
+    if (d->block_start) ok = ok && add_literal(&b, d->block_start, TOK_BLOCK_COMMENT) == 0;
+    for (int i = 0; d->quotes[i]; i++) {
+        char q[2] = { d->quotes[i], '\0' };
+        ok = ok && add_literal(&b, q, TOK_STRING + i) == 0;
+    }
+    
+    if (ok) {
+        /* merge bytes whose columns are identical into one class */
+        int rep[256];
+        lang->nclasses = 0;
+        for (int c = 0; c < 256; c++) {
+            int k;
+            for (k = 0; k < lang->nclasses; k++) {
+                int r = rep[k], s;
+                for (s = 0; s < b.nstates; s++) {
+                    if (b.next[s * 256 + c] != b.next[s * 256 + r]) break;
+                }
+                if (s == b.nstates) break;
+            }
+            if (k == lang->nclasses) rep[lang->nclasses++] = c;
+            lang->cls[c] = k;
+        }
+        
+        lang->nstates = b.nstates;
+        lang->next = malloc(sizeof(short) * b.nstates * lang->nclasses);
+        for (int s = 0; s < b.nstates; s++) {
+            for (int k = 0; k < lang->nclasses; k++) {
+                lang->next[s * lang->nclasses + k] = b.next[s * 256 + rep[k]];
+            }
+        }
+        lang->accept = b.accept;
+        b.accept = NULL;
+    }
+    
+    free(b.next);
+    free(b.accept);
+    return ok ? 0 : -1;
+}
+
+struct language *lang_compile(const char *text) {
+    struct langDef d;
+    memset(&d, 0, sizeof(d));
+    
+    char *copy = strdup(text);
+    for (char *line = copy, *nl; line; line = nl) {
+        nl = strchr(line, '\n');
+        if (nl) *nl++ = '\0';
+        char *t = trim(line);
+        if (*t && *t != '#') parse_line(&d, t);
+    }
+    free(copy);
+    
+    struct language *lang = NULL;
+    if (d.name[0] && d.npatterns > 0) {
+        lang = calloc(1, sizeof(struct language));
+        memcpy(lang->name, d.name, sizeof(lang->name));
+        lang->npatterns = d.npatterns;
+        lang->patterns = malloc(sizeof(char *) * d.npatterns);
+        for (int i = 0; i < d.npatterns; i++) lang->patterns[i] = strdup(d.patterns[i]);
+        if (d.block_end) strcpy(lang->block_end, d.block_end);
+        memcpy(lang->quotes, d.quotes, sizeof(lang->quotes));
+        memcpy(lang->multiline, d.multiline, sizeof(lang->multiline));
+        lang->escape = d.escape;
+        
+        if (compile_dfa(lang, &d) == -1) {
+            for (int i = 0; i < lang->npatterns; i++) free(lang->patterns[i]);
+            free(lang->patterns);
+            free(lang);
+            lang = NULL;
+        }
+    }
+    
+    for (int i = 0; i < d.nwords; i++) free(d.words[i]);
+    free(d.patterns);
+    return lang;
+}
+
+/* -------- registry -------- */
+static char *read_file(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) return NULL;
+    
+    size_t cap = 4096, len = 0, n;
+    char *text = malloc(cap);
+    while ((n = fread(text + len, 1, cap - len - 1, fp)) > 0) {
+        len += n;
+        if (cap - len == 1) {
+            cap *= 2;
+            text = realloc(text, cap);
+        }
+    }
+    text[len] = '\0';
+    fclose(fp);
+    return text;
+}
+
+static void lang_register(struct language *lang) {
+    lang->next_lang = languages;
+    languages = lang;
+}
+
+int lang_load_dir(const char *dir) {
+    int count = 0;
+    DIR *dp = dir ? opendir(dir) : NULL;
+    
+    if (dp) {
+        struct dirent *ent;
+        while ((ent = readdir(dp)) != NULL) {
+            const char *ext = strrchr(ent->d_name, '.');
+            if (!ext || strcmp(ext, ".lang") != 0) continue;
+            
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+            char *text = read_file(path);
+            if (!text) continue;
+            struct language *lang = lang_compile(text);
+            free(text);
+            if (lang) {
+                lang_register(lang);
+                count++;
+            }
+        }
+        closedir(dp);
+    }
+    
+    if (count == 0) {
+        struct language *lang = lang_compile(builtin_c);
+        if (lang) {
+            lang_register(lang);
+            count++;
+        }
+    }
+    return count;
+}
+
+const struct language *lang_for_file(const char *filename) {
+    if (!filename) return NULL;
+    const char *base = strrchr(filename, '/');
+    base = base ? base + 1 : filename;
+    const char *ext = strrchr(base, '.');
+    
+    for (struct language *lang = languages; lang; lang = lang->next_lang) {
+        for (int i = 0; i < lang->npatterns; i++) {
+            const char *p = lang->patterns[i];
+            if (p[0] == '.' ? (ext && strcmp(ext, p) == 0) : strcmp(base, p) == 0) {
+                return lang;
+            }
+        }
+    }
+    return NULL;
+}
+
+void lang_free_all(void) {
+    while (languages) {
+        struct language *lang = languages;
+        languages = lang->next_lang;
+        for (int i = 0; i < lang->npatterns; i++) free(lang->patterns[i]);
+        free(lang->patterns);
+        free(lang->next);
+        free(lang->accept);
+        free(lang);
+    }
+}
@@ -0,0 +1,53 @@
+/* lang.h - Language definitions compiled to DFA lexers */
+#ifndef LANG_H
+#define LANG_H
+
+#define LANG_MAX_QUOTES 4
+
+/* Token kinds accepted by a language DFA. String tokens add the index
+ * of their quote character: TOK_STRING + i. */
+enum langToken {
+    TOK_NONE = 0,
+    TOK_IDENT,
+    TOK_KEYWORD,
+    TOK_TYPE,
+    TOK_NUMBER,
+    TOK_LINE_COMMENT,
+    TOK_BLOCK_COMMENT,
+    TOK_STRING
+};
+
+struct language {
+    char name[32];
+    char **patterns;            /* ".ext" suffixes or exact basenames */
+    int npatterns;
+    
+    /* token DFA over byte classes: next[state * nclasses + cls[byte]] */
+    unsigned char cls[256];
+    int nclasses;
+    int nstates;
+    short *next;                /* -1 = no transition */
+    unsigned char *accept;      /* enum langToken per state */
+    
+    char block_end[8];          /* closes a block comment */
+    char quotes[LANG_MAX_QUOTES + 1];
+    char multiline[LANG_MAX_QUOTES];   /* quote may span lines */
+    char escape;                /* escape character in strings, or 0 */
+    
+    struct language *next_lang;
+};
+
+/* Compile a definition from its text; returns NULL if it is invalid */
+struct language *lang_compile(const char *text);
+
+/* Register every *.lang file in dir. The built-in C definition is used
+ * when none load. Returns the number of languages registered. */
+int lang_load_dir(const char *dir);
+
+/* Language whose patterns match the filename, or NULL */
+const struct language *lang_for_file(const char *filename);
+
+/* Free all registered languages */
+void lang_free_all(void);
+
+#endif /* LANG_H */
@@ -0,0 +1,526 @@
+/* piece.c - Piece table implementation */
+#define _POSIX_C_SOURCE 200809L
+
+#include "piece.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/* The original text is indexed, and counted ahead of the index, in
+ * chunks of this size */
+#define PIECE_CHUNK 65536
+
+static const char *piece_data(struct piecetable *pt, struct piece *p) {
+    return (p->src == PIECE_ORIG ? pt->orig : pt->add) + p->off;
+}
+
+static size_t count_nl(const char *s, size_t len) {
+    const char *end = s + len;
+    size_t n = 0;
+    while ((s = memchr(s, '\n', end - s)) != NULL) {
+        n++;
+        s++;
+    }
+    return n;
+}
+
+/* -------- newline index of the original -------- */
+static void *index_thread(void *arg) {
+    struct piecetable *pt = arg;
+    size_t nl = 0;
+    for (size_t c = 0; c < pt->nchunks; c++) {
+        size_t off = c * PIECE_CHUNK;
+        size_t n = pt->orig_len - off < PIECE_CHUNK ? pt->orig_len - off : PIECE_CHUNK;
+        nl += count_nl(pt->orig + off, n);
+        pt->orig_nl[c + 1] = nl;
+        
+        pthread_mutex_lock(&pt->index_lock);
+        pt->indexed = c + 1;
+        int stop = pt->index_stop;
+        pthread_mutex_unlock(&pt->index_lock);
+        if (stop) break;
+    }
+    return NULL;
+}
+
+/* Whether orig_nl[c] is final */
+static int index_ready(struct piecetable *pt, size_t c) {
+    if (c <= pt->indexed_seen) return 1;
+    if (!pt->index_running) return 0;
+    pthread_mutex_lock(&pt->index_lock);
+    pt->indexed_seen = pt->indexed;
+    pthread_mutex_unlock(&pt->index_lock);
+    return c <= pt->indexed_seen;
+}
+
+/* Newlines in the original before x; its chunk must be indexed */
+static size_t orig_nl_before(struct piecetable *pt, size_t x) {
+    size_t c = x / PIECE_CHUNK;
+    return pt->orig_nl[c] + count_nl(pt->orig + c * PIECE_CHUNK, x - c * PIECE_CHUNK);
+}
+
+/* Whether a run of the original is long and indexed, so the index is
+ * cheaper than reading it */
+static int use_index(struct piecetable *pt, size_t off, size_t len) {
+    return len > 2 * PIECE_CHUNK && index_ready(pt, (off + len) / PIECE_CHUNK);
+}
+
+/* Newlines in bytes [from, to) of piece p */
+static size_t piece_count(struct piecetable *pt, struct piece *p, size_t from, size_t to) {
+    if (p->src == PIECE_ORIG && use_index(pt, p->off + from, to - from)) {
+        return orig_nl_before(pt, p->off + to) - orig_nl_before(pt, p->off + from);
+    }
+    return count_nl(piece_data(pt, p) + from, to - from);
+}
+
+/* Offset in piece p of its k-th newline, which must exist */
+static size_t piece_find_nl(struct piecetable *pt, struct piece *p, size_t k) {
+    size_t from = 0;
+    if (p->src == PIECE_ORIG && use_index(pt, p->off, p->len)) {
+        /* the last chunk starting in p with fewer than k newlines
+         * before it, found by bisection */
+        size_t want = orig_nl_before(pt, p->off) + k;
+        size_t lo = p->off / PIECE_CHUNK + 1, hi = (p->off + p->len) / PIECE_CHUNK;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo + 1) / 2;
+            if (pt->orig_nl[mid] <= want) lo = mid;
+            else hi = mid - 1;
+        }
+        if (lo * PIECE_CHUNK > p->off && pt->orig_nl[lo] <= want) {
+            from = lo * PIECE_CHUNK - p->off;
+            k = want - pt->orig_nl[lo];
+        }
+    }
+    
+    const char *s = piece_data(pt, p);
+    const char *q = s + from;
+    for (;;) {
+        q = memchr(q, '\n', p->len - (q - s));
+        if (k-- == 0) break;
+        q++;
+    }
+    return q - s;
+}
+
+/* -------- treap -------- */
+static size_t tree_len(struct piece *t) {
+    return t ? t->sum_len : 0;
+}
+
+static size_t cached_nl(struct piece *t) {
+    return t ? t->sum_nl : 0;
+}
+
+/* Recompute a node's totals from its children */
+static void update(struct piece *t) {
+    t->sum_len = tree_len(t->left) + t->len + tree_len(t->right);
+    size_t l = cached_nl(t->left), r = cached_nl(t->right);
+    if (l == NL_UNKNOWN || t->nl == NL_UNKNOWN || r == NL_UNKNOWN) {
+        t->sum_nl = NL_UNKNOWN;
+    } else {
+        t->sum_nl = l + t->nl + r;
+    }
+}
+
+static struct piece *piece_new(struct piecetable *pt, int src, size_t off, size_t len, size_t nl) {
+    struct piece *p = malloc(sizeof(struct piece));
+    p->src = src;
+    p->off = off;
+    p->len = len;
+    p->nl = nl;
+    pt->seed ^= pt->seed << 13;
+    pt->seed ^= pt->seed >> 17;
+    pt->seed ^= pt->seed << 5;
+    p->prio = pt->seed;
+    p->left = p->right = NULL;
+    update(p);
+    return p;
+}
+
+static void tree_free(struct piece *t) {
+    if (!t) return;
+    tree_free(t->left);
+    tree_free(t->right);
+    free(t);
+}
+
+/* Concatenate two trees, every byte of a before every byte of b */
+static struct piece *merge(struct piece *a, struct piece *b) {
+    if (!a) return b;
+    if (!b) return a;
+    if (a->prio > b->prio) {
+        a->right = merge(a->right, b);
+        update(a);
+        return a;
+    }
+    b->left = merge(a, b->left);
+    update(b);
+    return b;
+}
+
+/* Cut piece t after its first `at` bytes; returns the tail as a new node */
+static struct piece *piece_cut(struct piecetable *pt, struct piece *t, size_t at) {
+    size_t head_nl = NL_UNKNOWN, tail_nl = NL_UNKNOWN;
+    if (t->nl != NL_UNKNOWN) {
+        /* count whichever side is shorter */
+        if (at <= t->len / 2) {
+            head_nl = piece_count(pt, t, 0, at);
+            tail_nl = t->nl - head_nl;
+        } else {
+            tail_nl = piece_count(pt, t, at, t->len);
+            head_nl = t->nl - tail_nl;
+        }
+    }
+    struct piece *tail = piece_new(pt, t->src, t->off + at, t->len - at, tail_nl);
+    t->len = at;
+    t->nl = head_nl;
+    return tail;
+}
+
+/* Shorten the piece that straddles pos so it ends there, fixing the
+ * totals on the way back up; returns the cut-off tail, which is not in
+ * the tree, or NULL if pos is already between pieces */
+static struct piece *cut_at(struct piecetable *pt, struct piece *t, size_t pos) {
+    if (!t) return NULL;
+    struct piece *tail = NULL;
+    size_t left_len = tree_len(t->left);
+    if (pos < left_len) {
+        tail = cut_at(pt, t->left, pos);
+    } else if (pos > left_len + t->len) {
+        tail = cut_at(pt, t->right, pos - left_len - t->len);
+    } else if (pos > left_len && pos < left_len + t->len) {
+        tail = piece_cut(pt, t, pos - left_len);
+    }
+    if (tail) update(t);
+    return tail;
+}
+
+/* Split t, which has a piece boundary at pos, so *l holds the first pos
+ * bytes and *r the rest */
+static void split_between(struct piece *t, size_t pos, struct piece **l, struct piece **r) {
+    if (!t) {
+        *l = *r = NULL;
+        return;
+    }
+    size_t left_len = tree_len(t->left);
+    if (pos <= left_len) {
+        split_between(t->left, pos, l, &t->left);
+        *r = t;
+    } else {
+        split_between(t->right, pos - left_len - t->len, &t->right, r);
+        *l = t;
+    }
+    update(t);
+}
+
+/* Split t so *l holds the first pos bytes and *r the rest. A piece that
+ * straddles pos is cut first and its tail merged into *r by its own
+ * priority, so both halves stay treaps. */
+static void split(struct piecetable *pt, struct piece *t, size_t pos,
+                  struct piece **l, struct piece **r) {
+    struct piece *tail = cut_at(pt, t, pos);
+    split_between(t, pos, l, r);
+    if (tail) *r = merge(tail, *r);
+}
+
+/* Piece holding pos; *off is set to pos's offset within it */
+static struct piece *seek_pos(struct piecetable *pt, size_t pos, size_t *off) {
+    struct piece *t = pt->root;
+    while (t) {
+        size_t left_len = tree_len(t->left);
+        if (pos < left_len) {
+            t = t->left;
+        } else if (pos < left_len + t->len) {
+            *off = pos - left_len;
+            return t;
+        } else {
+            pos -= left_len + t->len;
+            t = t->right;
+        }
+    }
+    return NULL;
+}
+
+/* -------- table -------- */
+struct piecetable *pt_open(const char *map, size_t len) {
+    struct piecetable *pt = malloc(sizeof(struct piecetable));
+    pt->orig = map;
+    pt->orig_len = len;
+    pt->add_cap = 4096;
+    pt->add = malloc(pt->add_cap);
+    pt->add_len = 0;
+    pt->frozen = 0;
+    pt->add_frozen = 0;
+    pt->retired = NULL;
+    pt->nretired = 0;
+    pt->seed = 2463534242u;
+    pt->root = len ? piece_new(pt, PIECE_ORIG, 0, len, NL_UNKNOWN) : NULL;
+    pt->len = len;
+    pt->cursor = 0;
+    pt->counted = 0;
+    
+    /* the index pages in only as the thread fills it */
+    pt->nchunks = (len + PIECE_CHUNK - 1) / PIECE_CHUNK;
+    pt->orig_nl = malloc(sizeof(size_t) * (pt->nchunks + 1));
+    pt->orig_nl[0] = 0;
+    pt->indexed = pt->indexed_seen = 0;
+    pt->index_stop = 0;
+    pthread_mutex_init(&pt->index_lock, NULL);
+    pt->index_running = pthread_create(&pt->index_thread, NULL, index_thread, pt) == 0;
+    return pt;
+}
+
+void pt_free(struct piecetable *pt) {
+    if (pt->index_running) {
+        pthread_mutex_lock(&pt->index_lock);
+        pt->index_stop = 1;
+        pthread_mutex_unlock(&pt->index_lock);
+        pthread_join(pt->index_thread, NULL);
+    }
+    pthread_mutex_destroy(&pt->index_lock);
+    free(pt->orig_nl);
+    if (pt->orig && pt->orig_len) munmap((void *)pt->orig, pt->orig_len);
+    pt_thaw(pt);
+    tree_free(pt->root);
+    free(pt->add);
+    free(pt);
+}
+
+void pt_freeze(struct piecetable *pt) {
+    pt->frozen = 1;
+    pt->add_frozen = pt->add_len;
+}
+
+void pt_thaw(struct piecetable *pt) {
+    for (int i = 0; i < pt->nretired; i++) free(pt->retired[i]);
+    free(pt->retired);
+    pt->retired = NULL;
+    pt->nretired = 0;
+    pt->frozen = 0;
+    pt->add_frozen = 0;
+}
+
+/* -------- editing -------- */
+/* Make room for n more bytes in the add buffer */
+static void add_reserve(struct piecetable *pt, size_t n) {
+    if (pt->add_cap - pt->add_len < n) {
+        while (pt->add_cap - pt->add_len < n) pt->add_cap *= 2;
+        if (pt->frozen) {
+            /* a reader may still hold the old buffer */
+            char *add = malloc(pt->add_cap);
+            memcpy(add, pt->add, pt->add_len);
+            pt->retired = realloc(pt->retired, sizeof(char *) * (pt->nretired + 1));
+            pt->retired[pt->nretired++] = pt->add;
+            pt->add = add;
+        } else {
+            pt->add = realloc(pt->add, pt->add_cap);
+        }
+    }
+}
+
+void pt_insert(struct piecetable *pt, size_t pos, char c) {
+    pt_insert_n(pt, pos, &c, 1);
+}
+
+void pt_insert_n(struct piecetable *pt, size_t pos, const char *s, size_t n) {
+    if (n == 0) return;
+    add_reserve(pt, n);
+    size_t add_off = pt->add_len;
+    memcpy(pt->add + add_off, s, n);
+    pt->add_len += n;
+    size_t nl = count_nl(s, n);
+    pt->len += n;
+    /* inserted text is counted as it comes */
+    if (pos <= pt->counted) pt->counted += n;
+    
+    /* typing on from the previous insert: grow that piece in place */
+    size_t off;
+    struct piece *prev = pos ? seek_pos(pt, pos - 1, &off) : NULL;
+    if (prev && prev->src == PIECE_ADD && off == prev->len - 1 &&
+        prev->off + prev->len == add_off) {
+        struct piece *t = pt->root;
+        size_t at = pos - 1;
+        for (;;) {
+            t->sum_len += n;
+            if (t->sum_nl != NL_UNKNOWN) t->sum_nl += nl;
+            if (t == prev) break;
+            size_t left_len = tree_len(t->left);
+            if (at < left_len) {
+                t = t->left;
+            } else {
+                at -= left_len + t->len;
+                t = t->right;
+            }
+        }
+        prev->len += n;
+        prev->nl += nl;
+        return;
+    }
+    
+    struct piece *l, *r;
+    split(pt, pt->root, pos, &l, &r);
+    struct piece *p = piece_new(pt, PIECE_ADD, add_off, n, nl);
+    pt->root = merge(merge(l, p), r);
+}
+
+void pt_delete(struct piecetable *pt, size_t pos) {
+    pt_delete_range(pt, pos, 1);
+}
+
+void pt_delete_range(struct piecetable *pt, size_t pos, size_t n) {
+    if (pos >= pt->len || n == 0) return;
+    if (n > pt->len - pos) n = pt->len - pos;
+    struct piece *l, *m, *r;
+    split(pt, pt->root, pos, &l, &r);
+    split(pt, r, n, &m, &r);
+    /* just-typed text gives its bytes back to the add buffer */
+    if (!m->left && !m->right && m->src == PIECE_ADD &&
+        m->off + m->len == pt->add_len && m->off >= pt->add_frozen) {
+        pt->add_len -= m->len;
+    }
+    tree_free(m);
+    pt->root = merge(l, r);
+    pt->len -= n;
+    if (pos + n <= pt->counted) pt->counted -= n;
+    else if (pos < pt->counted) pt->counted = pos;
+}
+
+char pt_char_at(struct piecetable *pt, size_t pos) {
+    size_t off;
+    struct piece *p = seek_pos(pt, pos, &off);
+    return p ? piece_data(pt, p)[off] : '\0';
+}
+
+const char *pt_span(struct piecetable *pt, size_t pos, size_t *len) {
+    size_t off;
+    struct piece *p = seek_pos(pt, pos, &off);
+    if (!p) {
+        *len = 0;
+        return NULL;
+    }
+    *len = p->len - off;
+    return piece_data(pt, p) + off;
+}
+
+const char *pt_span_before(struct piecetable *pt, size_t pos, size_t *len) {
+    size_t off;
+    struct piece *p = pos ? seek_pos(pt, pos - 1, &off) : NULL;
+    if (!p) {
+        *len = 0;
+        return NULL;
+    }
+    *len = off + 1;
+    return piece_data(pt, p);
+}
+
+/* -------- line index -------- */
+/* Fix the totals on the path to the piece at pos */
+static void refresh_path(struct piece *t, size_t pos) {
+    size_t left_len = tree_len(t->left);
+    if (pos < left_len) refresh_path(t->left, pos);
+    else if (pos >= left_len + t->len) refresh_path(t->right, pos - left_len - t->len);
+    update(t);
+}
+
+/* Count the piece at the frontier and move past it. Original text the
+ * index has not reached is cut off a chunk at a time, so no step reads
+ * more than PIECE_CHUNK bytes. */
+static void count_next(struct piecetable *pt) {
+    size_t off;
+    struct piece *p = seek_pos(pt, pt->counted, &off);
+    if (p->nl == NL_UNKNOWN) {
+        size_t chunk = PIECE_CHUNK - p->off % PIECE_CHUNK;
+        if (p->src == PIECE_ORIG && p->len > chunk && !use_index(pt, p->off, p->len)) {
+            struct piece *l, *r;
+            split(pt, pt->root, pt->counted + chunk, &l, &r);
+            pt->root = merge(l, r);
+            p = seek_pos(pt, pt->counted, &off);
+        }
+        p->nl = piece_count(pt, p, 0, p->len);
+        refresh_path(pt->root, pt->counted);
+    }
+    pt->counted += p->len;
+}
+
+static void count_upto(struct piecetable *pt, size_t pos) {
+    while (pt->counted < pos && pt->counted < pt->len) count_next(pt);
+}
+
+/* Newlines before pos; the pieces before it, and the one it is in,
+ * must be counted */
+static size_t nl_before(struct piecetable *pt, size_t pos) {
+    struct piece *t = pt->root;
+    size_t row = 0;
+    while (t) {
+        size_t left_len = tree_len(t->left);
+        if (pos < left_len) {
+            t = t->left;
+            continue;
+        }
+        row += cached_nl(t->left);
+        pos -= left_len;
+        if (pos < t->len) return row + (pos ? piece_count(pt, t, 0, pos) : 0);
+        row += t->nl;
+        pos -= t->len;
+        t = t->right;
+    }
+    return row;
+}
+
+size_t pt_line_count(struct piecetable *pt) {
+    count_upto(pt, pt->len);
+    return cached_nl(pt->root) + 1;
+}
+
+size_t pt_lines_upto(struct piecetable *pt, size_t limit) {
+    while (pt->counted < pt->len && nl_before(pt, pt->counted) + 1 < limit) count_next(pt);
+    if (pt->counted < pt->len) return limit;
+    size_t lines = cached_nl(pt->root) + 1;
+    return lines < limit ? lines : limit;
+}
+
+int pt_line_count_ready(struct piecetable *pt, size_t *count) {
+    if (pt->counted < pt->len && !index_ready(pt, pt->nchunks)) return 0;
+    *count = pt_line_count(pt);
+    return 1;
+}
+
+/* Position of the k-th newline, or the text length past the last one */
+static size_t nl_pos(struct piecetable *pt, size_t k) {
+    while (pt->counted < pt->len && nl_before(pt, pt->counted) <= k) count_next(pt);
+    if (pt->counted == pt->len && k >= cached_nl(pt->root)) return pt->len;
+    
+    /* the k-th newline is in the counted part, so a subtree whose total
+     * is unknown holds the frontier and everything after it */
+    struct piece *t = pt->root;
+    size_t pos = 0;
+    for (;;) {
+        size_t left_nl = cached_nl(t->left);
+        if (left_nl == NL_UNKNOWN || k < left_nl) {
+            t = t->left;
+            continue;
+        }
+        k -= left_nl;
+        pos += tree_len(t->left);
+        if (k < t->nl) break;
+        k -= t->nl;
+        pos += t->len;
+        t = t->right;
+    }
+    return pos + piece_find_nl(pt, t, k);
+}
+
+size_t pt_line_start(struct piecetable *pt, size_t row) {
+    if (row == 0) return 0;
+    size_t pos = nl_pos(pt, row - 1);
+    return pos < pt->len ? pos + 1 : pos;
+}
+
+size_t pt_line_end(struct piecetable *pt, size_t row) {
+    return nl_pos(pt, row);
+}
+
+size_t pt_line_of(struct piecetable *pt, size_t pos) {
+    count_upto(pt, pos + 1);
+    return nl_before(pt, pos);
+}
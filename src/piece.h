@@ -0,0 +1,114 @@
+/* piece.h - Piece table text storage over a read-only file mapping */
+#ifndef PIECE_H
+#define PIECE_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+#define PIECE_ORIG 0
+#define PIECE_ADD  1
+
+#define NL_UNKNOWN ((size_t)-1)
+
+/* A run of text taken from the original mapping or the add buffer, kept
+ * in a treap ordered by document position. Every node caches the byte
+ * and newline totals of its subtree, so seeking by position or by line
+ * costs O(log n) in the number of pieces. A subtree's newline total is
+ * unknown while any piece in it has not been counted. */
+struct piece {
+    int src;
+    size_t off;
+    size_t len;
+    size_t nl;              /* newlines in the run, NL_UNKNOWN until counted */
+    size_t sum_len;         /* bytes in this subtree */
+    size_t sum_nl;          /* newlines in this subtree, or NL_UNKNOWN */
+    unsigned prio;
+    struct piece *left;
+    struct piece *right;
+};
+
+struct piecetable {
+    const char *orig;       /* read-only mapping of the file, or NULL */
+    size_t orig_len;
+    char *add;              /* append-only buffer of inserted text */
+    size_t add_len;
+    size_t add_cap;
+    /* while frozen, add[0, add_frozen) is being read elsewhere: it is
+     * never overwritten, and outgrown add buffers are kept in retired */
+    int frozen;
+    size_t add_frozen;
+    char **retired;
+    int nretired;
+    struct piece *root;
+    unsigned seed;          /* treap priorities */
+    size_t len;             /* total text length */
+    size_t cursor;          /* insertion point */
+    /* every piece before this position has its newlines counted; line
+     * queries move it forward only as far as they need */
+    size_t counted;
+    /* orig_nl[c] is the number of newlines before chunk c of the original
+     * text, filled in from the start by an index thread. Entries up to
+     * indexed are final; indexed_seen is the editor's copy. */
+    size_t *orig_nl;
+    size_t nchunks;
+    size_t indexed;         /* under index_lock */
+    size_t indexed_seen;
+    int index_stop;
+    int index_running;
+    pthread_t index_thread;
+    pthread_mutex_t index_lock;
+};
+
+/* Create a piece table over a mapping of len bytes. The table owns the
+ * mapping and unmaps it when freed. The text starts as a single piece
+ * and is not read here; a background thread indexes its newlines. */
+struct piecetable *pt_open(const char *map, size_t len);
+
+/* Free the table and unmap the original file */
+void pt_free(struct piecetable *pt);
+
+/* Promise that the text's current storage stays intact until pt_thaw,
+ * so spans taken now can be read from another thread */
+void pt_freeze(struct piecetable *pt);
+void pt_thaw(struct piecetable *pt);
+
+/* Insert a character at pos */
+void pt_insert(struct piecetable *pt, size_t pos, char c);
+
+/* Insert n bytes at pos as a single piece */
+void pt_insert_n(struct piecetable *pt, size_t pos, const char *s, size_t n);
+
+/* Delete the character at pos */
+void pt_delete(struct piecetable *pt, size_t pos);
+
+/* Delete n bytes starting at pos */
+void pt_delete_range(struct piecetable *pt, size_t pos, size_t n);
+
+/* Get character at pos */
+char pt_char_at(struct piecetable *pt, size_t pos);
+
+/* Contiguous run of text starting at pos, or NULL at the end */
+const char *pt_span(struct piecetable *pt, size_t pos, size_t *len);
+
+/* Contiguous run of text ending at pos, or NULL at the start */
+const char *pt_span_before(struct piecetable *pt, size_t pos, size_t *len);
+
+/* Line index. Newlines are counted in document order only as far as a
+ * query needs, reading at most a chunk of unindexed text per piece, and
+ * kept up to date by edits afterwards. */
+
+/* Number of lines; counts the rest of the text if it must */
+size_t pt_line_count(struct piecetable *pt);
+
+/* Number of lines, or limit if there are at least that many */
+size_t pt_lines_upto(struct piecetable *pt, size_t limit);
+
+/* Set *count and return 1 if the number of lines is known without
+ * reading text the index thread has not reached yet */
+int pt_line_count_ready(struct piecetable *pt, size_t *count);
+
+size_t pt_line_start(struct piecetable *pt, size_t row);
+size_t pt_line_end(struct piecetable *pt, size_t row);
+size_t pt_line_of(struct piecetable *pt, size_t pos);
+
+#endif /* PIECE_H */
@@ -0,0 +1,760 @@
+/* regex.c - Regular expressions compiled to a lazily built DFA */
+#include "regex.h"
+#include "buffer.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Limits that keep compiled patterns and DFA caches bounded */
+#define REGEX_MAX_REPEAT 1000
+#define REGEX_MAX_INSTS 20000
+#define DFA_MAX_STATES 2048
+/* States are allocated as the cache grows, from this many */
+#define DFA_MIN_STATES 16
+
+/* -------- syntax tree -------- */
+enum reNodeType {
+    N_EMPTY,
+    N_CLASS,        /* one byte from a set */
+    N_CAT,
+    N_ALT,
+    N_REPEAT,       /* a{min,max}; max -1 is unbounded */
+    N_BOL,
+    N_EOL
+};
+
+struct reNode {
+    enum reNodeType type;
+    int a, b;               /* children */
+    int cls;                /* N_CLASS: index into the class table */
+    int min, max;
+    int greedy;
+};
+
+struct reParser {
+    const char *s;
+    size_t len, pos;
+    struct reNode *nodes;
+    int nnodes, cap;
+    unsigned char (*classes)[32];
+    int nclasses, ccap;
+    const char *error;
+};
+
+static int node_new(struct reParser *p, enum reNodeType type, int a, int b) {
+    if (p->nnodes == p->cap) {
+        p->cap = p->cap ? p->cap * 2 : 64;
+        p->nodes = realloc(p->nodes, sizeof(struct reNode) * p->cap);
+    }
+    struct reNode *n = &p->nodes[p->nnodes];
+    memset(n, 0, sizeof(*n));
+    n->type = type;
+    n->a = a;
+    n->b = b;
+    return p->nnodes++;
+}
+
+static int class_new(struct reParser *p) {
+    if (p->nclasses == p->ccap) {
+        p->ccap = p->ccap ? p->ccap * 2 : 16;
+        p->classes = realloc(p->classes, 32 * p->ccap);
+    }
+    memset(p->classes[p->nclasses], 0, 32);
+    return p->nclasses++;
+}
+
+static void class_add(unsigned char *set, int c) {
+    set[c >> 3] |= 1 << (c & 7);
+}
+
+static int class_has(const unsigned char *set, int c) {
+    return set[c >> 3] & (1 << (c & 7));
+}
+
+static void class_add_range(unsigned char *set, int lo, int hi) {
+    for (int c = lo; c <= hi; c++) class_add(set, c);
+}
+
+static void class_invert(unsigned char *set) {
+    for (int i = 0; i < 32; i++) set[i] = ~set[i];
+}
+
+/* Add the set named by \d, \w or \s (any case) to set;
+ * returns 0 if c names none of them */
+static int class_escape(unsigned char *set, int c) {
+    unsigned char named[32] = { 0 };
+    switch (c | 0x20) {
+        case 'd':
+            class_add_range(named, '0', '9');
+            break;
+        case 'w':
+            class_add_range(named, '0', '9');
+            class_add_range(named, 'a', 'z');
+            class_add_range(named, 'A', 'Z');
+            class_add(named, '_');
+            break;
+        case 's':
+            class_add_range(named, '\t', '\r');
+            class_add(named, ' ');
+            break;
+        default:
+            return 0;
+    }
+    if (c >= 'A' && c <= 'Z') class_invert(named);
+    for (int i = 0; i < 32; i++) set[i] |= named[i];
+    return 1;
+}
+
+/* The byte an escape stands for, or -1 for a letter that has no
+ * meaning here */
+static int escape_byte(struct reParser *p, int c) {
+    switch (c) {
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'r': return '\r';
+        case 'f': return '\f';
+        case 'v': return '\v';
+        case '0': return '\0';
+    }
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+        p->error = "unsupported escape";
+        return -1;
+    }
+    return c;
+}
+
+static int peek(struct reParser *p) {
+    return p->pos < p->len ? (unsigned char)p->s[p->pos] : -1;
+}
+
+static int parse_alt(struct reParser *p);
+
+/* [...] after the opening bracket */
+static int parse_class(struct reParser *p) {
+    int cls = class_new(p);
+    int negate = 0, first = 1;
+    if (peek(p) == '^') {
+        negate = 1;
+        p->pos++;
+    }
+    for (;;) {
+        int c = peek(p);
+        if (c == -1) {
+            p->error = "missing ]";
+            return -1;
+        }
+        p->pos++;
+        if (c == ']' && !first) break;
+        first = 0;
+        if (c == '\\') {
+            if (peek(p) == -1) {
+                p->error = "trailing \\";
+                return -1;
+            }
+            c = (unsigned char)p->s[p->pos++];
+            if (class_escape(p->classes[cls], c)) continue;
+            c = escape_byte(p, c);
+            if (c == -1) return -1;
+        }
+        int hi = c;
+        if (peek(p) == '-' && p->pos + 1 < p->len && p->s[p->pos + 1] != ']') {
+            p->pos++;
+            hi = (unsigned char)p->s[p->pos++];
+            if (hi == '\\' && p->pos < p->len) hi = escape_byte(p, (unsigned char)p->s[p->pos++]);
+            if (hi == -1) return -1;
+            if (hi < c) {
+                p->error = "bad range";
+                return -1;
+            }
+        }
+        class_add_range(p->classes[cls], c, hi);
+    }
+    if (negate) class_invert(p->classes[cls]);
+    int n = node_new(p, N_CLASS, -1, -1);
+    p->nodes[n].cls = cls;
+    return n;
+}
+
+static int parse_atom(struct reParser *p) {
+    int c = peek(p);
+    p->pos++;
+    int n, cls;
+    switch (c) {
+        case '(':
+            n = parse_alt(p);
+            if (n == -1) return -1;
+            if (peek(p) != ')') {
+                p->error = "missing )";
+                return -1;
+            }
+            p->pos++;
+            return n;
+        case '[':
+            return parse_class(p);
+        case '^':
+            return node_new(p, N_BOL, -1, -1);
+        case '$':
+            return node_new(p, N_EOL, -1, -1);
+        case '*': case '+': case '?':
+            p->error = "nothing to repeat";
+            return -1;
+        case '.':
+            cls = class_new(p);
+            class_add(p->classes[cls], '\n');
+            class_invert(p->classes[cls]);
+            break;
+        case '\\':
+            if (peek(p) == -1) {
+                p->error = "trailing \\";
+                return -1;
+            }
+            c = (unsigned char)p->s[p->pos++];
+            cls = class_new(p);
+            if (!class_escape(p->classes[cls], c)) {
+                c = escape_byte(p, c);
+                if (c == -1) return -1;
+                class_add(p->classes[cls], c);
+            }
+            break;
+        default:
+            cls = class_new(p);
+            class_add(p->classes[cls], c);
+            break;
+    }
+    n = node_new(p, N_CLASS, -1, -1);
+    p->nodes[n].cls = cls;
+    return n;
+}
+
+/* A decimal count inside {m,n} */
+static int parse_count(struct reParser *p) {
+    int n = -1;
+    while (peek(p) >= '0' && peek(p) <= '9') {
+        n = (n < 0 ? 0 : n) * 10 + (p->s[p->pos++] - '0');
+        if (n > REGEX_MAX_REPEAT) {
+            p->error = "repeat count too large";
+            return -2;
+        }
+    }
+    return n;
+}
+
+static int parse_repeat(struct reParser *p) {
+    int n = parse_atom(p);
+    while (n != -1) {
+        int c = peek(p), min, max;
+        if (c == '*') {
+            min = 0;
+            max = -1;
+        } else if (c == '+') {
+            min = 1;
+            max = -1;
+        } else if (c == '?') {
+            min = 0;
+            max = 1;
+        } else if (c == '{') {
+            size_t save = p->pos++;
+            min = parse_count(p);
+            max = min;
+            if (min >= 0 && peek(p) == ',') {
+                p->pos++;
+                max = parse_count(p);
+            }
+            if (min == -2 || max == -2) return -1;
+            if (min < 0 || peek(p) != '}') {
+                /* not a count; the brace is a literal */
+                p->pos = save;
+                return n;
+            }
+            if (max != -1 && max < min) {
+                p->error = "bad repeat count";
+                return -1;
+            }
+        } else {
+            return n;
+        }
+        p->pos++;
+        int r = node_new(p, N_REPEAT, n, -1);
+        p->nodes[r].min = min;
+        p->nodes[r].max = max;
+        p->nodes[r].greedy = 1;
+        if (peek(p) == '?') {
+            p->nodes[r].greedy = 0;
+            p->pos++;
+        }
+        n = r;
+    }
+    return n;
+}
+
+static int parse_cat(struct reParser *p) {
+    int n = node_new(p, N_EMPTY, -1, -1);
+    while (peek(p) != -1 && peek(p) != '|' && peek(p) != ')') {
+        int r = parse_repeat(p);
+        if (r == -1) return -1;
+        n = node_new(p, N_CAT, n, r);
+    }
+    return n;
+}
+
+static int parse_alt(struct reParser *p) {
+    int n = parse_cat(p);
+    while (n != -1 && peek(p) == '|') {
+        p->pos++;
+        int r = parse_cat(p);
+        if (r == -1) return -1;
+        n = node_new(p, N_ALT, n, r);
+    }
+    return n;
+}
+
+/* -------- program -------- */
+enum reOp {
+    OP_CLASS,       /* consume a byte in cls, go to x */
+    OP_SPLIT,       /* try x, then y */
+    OP_JMP,
+    OP_BOL,
+    OP_EOL,
+    OP_MATCH
+};
+
+struct reInst {
+    unsigned char op;
+    int cls;
+    int x, y;
+};
+
+struct reProg {
+    struct reInst *insts;
+    int n, cap;
+    const unsigned char (*classes)[32];
+};
+
+static int emit(struct reProg *prog, enum reOp op, int x, int y) {
+    if (prog->n == prog->cap) {
+        prog->cap = prog->cap ? prog->cap * 2 : 64;
+        prog->insts = realloc(prog->insts, sizeof(struct reInst) * prog->cap);
+    }
+    struct reInst *in = &prog->insts[prog->n];
+    in->op = op;
+    in->cls = -1;
+    in->x = x;
+    in->y = y;
+    return prog->n++;
+}
+
+/* Emit code for node; reversed code matches the text read backward */
+static int gen(struct reProg *prog, const struct reNode *nodes, int node, int reverse) {
+    const struct reNode *n = &nodes[node];
+    if (prog->n > REGEX_MAX_INSTS) return -1;
+    int pc, loop;
+    switch (n->type) {
+        case N_EMPTY:
+            break;
+        case N_CLASS:
+            pc = emit(prog, OP_CLASS, prog->n + 1, 0);
+            prog->insts[pc].cls = n->cls;
+            break;
+        case N_CAT:
+            if (gen(prog, nodes, reverse ? n->b : n->a, reverse) == -1) return -1;
+            if (gen(prog, nodes, reverse ? n->a : n->b, reverse) == -1) return -1;
+            break;
+        case N_ALT:
+            pc = emit(prog, OP_SPLIT, prog->n + 1, 0);
+            if (gen(prog, nodes, n->a, reverse) == -1) return -1;
+            loop = emit(prog, OP_JMP, 0, 0);
+            prog->insts[pc].y = prog->n;
+            if (gen(prog, nodes, n->b, reverse) == -1) return -1;
+            prog->insts[loop].x = prog->n;
+            break;
+        case N_REPEAT:
+            for (int i = 0; i < n->min; i++) {
+                if (gen(prog, nodes, n->a, reverse) == -1) return -1;
+            }
+            if (n->max == -1) {
+                loop = emit(prog, OP_SPLIT, 0, 0);
+                if (gen(prog, nodes, n->a, reverse) == -1) return -1;
+                emit(prog, OP_JMP, loop, 0);
+                prog->insts[loop].x = n->greedy ? loop + 1 : prog->n;
+                prog->insts[loop].y = n->greedy ? prog->n : loop + 1;
+            }
+            for (int i = n->min; i < n->max; i++) {
+                pc = emit(prog, OP_SPLIT, 0, 0);
+                if (gen(prog, nodes, n->a, reverse) == -1) return -1;
+                prog->insts[pc].x = n->greedy ? pc + 1 : prog->n;
+                prog->insts[pc].y = n->greedy ? prog->n : pc + 1;
+            }
+            break;
+        case N_BOL:
+            emit(prog, reverse ? OP_EOL : OP_BOL, prog->n + 1, 0);
+            break;
+        case N_EOL:
+            emit(prog, reverse ? OP_BOL : OP_EOL, prog->n + 1, 0);
+            break;
+    }
+    return 0;
+}
+
+/* -------- lazy DFA -------- */
+/* A DFA state is the ordered list of NFA threads still alive, highest
+ * priority first. Transitions are worked out the first time each byte
+ * is seen in a state and cached; the cache is dropped when it fills. */
+struct reState {
+    int *list;
+    int n;
+    int inject;             /* a new thread starts at every position */
+    int bol;                /* the previous byte ended a line */
+    signed char eof[2];     /* match at the end, without and with $ there */
+};
+
+/* A cached transition: the next state's row in the table, shifted past
+ * two flags so the scan loop needs a single load per byte */
+#define TRANS_MATCH 1       /* a match ends before the byte */
+#define TRANS_DEAD 2        /* no match can follow */
+#define TRANS_SHIFT 2
+
+struct reDfa {
+    struct reProg prog;
+    int longest;            /* keep going after a match instead of cutting */
+    struct reState *states;
+    int *trans;             /* 256 transitions per state, -1 if not known */
+    int nstates;
+    int cap;                /* states allocated */
+    unsigned flushes;
+    int *table;             /* hash of states, index + 1; 0 is empty */
+    int tsize;
+    int *buf1, *buf2, *stack;
+    unsigned *mark;
+    unsigned gen;
+};
+
+struct regex {
+    struct reDfa fwd;       /* finds where the leftmost match ends */
+    struct reDfa rev;       /* finds the last match start, reading backward */
+    struct reDfa rev_longest;   /* from a match end back to its start */
+    unsigned char (*classes)[32];
+};
+
+static unsigned state_hash(const int *list, int n, int inject, int bol) {
+    unsigned h = 2166136261u ^ (inject << 1) ^ bol;
+    for (int i = 0; i < n; i++) h = (h ^ (unsigned)list[i]) * 16777619u;
+    return h;
+}
+
+static void dfa_flush(struct reDfa *d) {
+    for (int i = 0; i < d->nstates; i++) free(d->states[i].list);
+    d->nstates = 0;
+    d->flushes++;
+    memset(d->table, 0, sizeof(int) * d->tsize);
+}
+
+static void dfa_init(struct reDfa *d, int longest) {
+    d->longest = longest;
+    d->cap = DFA_MIN_STATES;
+    d->states = malloc(sizeof(struct reState) * d->cap);
+    d->trans = malloc(sizeof(int) * 256 * d->cap);
+    d->nstates = 0;
+    d->flushes = 0;
+    d->tsize = DFA_MAX_STATES * 2;
+    d->table = calloc(d->tsize, sizeof(int));
+    d->buf1 = malloc(sizeof(int) * d->prog.n);
+    d->buf2 = malloc(sizeof(int) * d->prog.n);
+    d->stack = malloc(sizeof(int) * (d->prog.n * 2 + 2));
+    d->mark = calloc(d->prog.n, sizeof(unsigned));
+    d->gen = 0;
+}
+
+static void dfa_free(struct reDfa *d) {
+    dfa_flush(d);
+    free(d->states);
+    free(d->trans);
+    free(d->table);
+    free(d->buf1);
+    free(d->buf2);
+    free(d->stack);
+    free(d->mark);
+    free(d->prog.insts);
+}
+
+/* Add the thread at pc and everything it reaches without consuming a
+ * byte, in priority order. With eol < 0 end-of-line checks are left
+ * in the list to be settled once the next byte is known. */
+static void add_thread(struct reDfa *d, int *list, int *n, int pc, int bol, int eol) {
+    int sp = 0;
+    d->stack[sp++] = pc;
+    while (sp > 0) {
+        pc = d->stack[--sp];
+        if (d->mark[pc] == d->gen) continue;
+        d->mark[pc] = d->gen;
+        const struct reInst *in = &d->prog.insts[pc];
+        switch (in->op) {
+            case OP_JMP:
+                d->stack[sp++] = in->x;
+                break;
+            case OP_SPLIT:
+                d->stack[sp++] = in->y;
+                d->stack[sp++] = in->x;
+                break;
+            case OP_BOL:
+                if (bol) d->stack[sp++] = in->x;
+                break;
+            case OP_EOL:
+                if (eol < 0) list[(*n)++] = pc;
+                else if (eol) d->stack[sp++] = in->x;
+                break;
+            default:
+                list[(*n)++] = pc;
+                break;
+        }
+    }
+}
+
+static int dfa_intern(struct reDfa *d, const int *list, int n, int inject, int bol) {
+    unsigned h = state_hash(list, n, inject, bol);
+    int mask = d->tsize - 1;
+    for (int i = h & mask; ; i = (i + 1) & mask) {
+        int si = d->table[i] - 1;
+        if (si < 0) break;
+        struct reState *s = &d->states[si];
+        if (s->n == n && s->inject == inject && s->bol == bol &&
+            memcmp(s->list, list, sizeof(int) * n) == 0) {
+            return si;
+        }
+    }
+    if (d->nstates == DFA_MAX_STATES) dfa_flush(d);
+    if (d->nstates == d->cap) {
+        d->cap *= 2;
+        d->states = realloc(d->states, sizeof(struct reState) * d->cap);
+        d->trans = realloc(d->trans, sizeof(int) * 256 * d->cap);
+    }
+    
+    int si = d->nstates++;
+    struct reState *s = &d->states[si];
+    s->list = malloc(sizeof(int) * (n ? n : 1));
+    memcpy(s->list, list, sizeof(int) * n);
+    s->n = n;
+    s->inject = inject;
+    s->bol = bol;
+    memset(d->trans + 256 * si, 0xff, sizeof(int) * 256);
+    s->eof[0] = s->eof[1] = -1;
+    int i = h & mask;
+    while (d->table[i]) i = (i + 1) & mask;
+    d->table[i] = si + 1;
+    return si;
+}
+
+static int dfa_start(struct reDfa *d, int bol, int inject) {
+    int n = 0;
+    d->gen++;
+    add_thread(d, d->buf2, &n, 0, bol, -1);
+    return dfa_intern(d, d->buf2, n, inject, bol);
+}
+
+/* Settle the end-of-line checks of state si for what follows it;
+ * returns 1 if a thread matches there. Unless looking for the longest
+ * match, threads below a match lose to it and are cut off. */
+static int dfa_settle(struct reDfa *d, int si, int eol, int *n1) {
+    const struct reState *s = &d->states[si];
+    *n1 = 0;
+    d->gen++;
+    for (int i = 0; i < s->n; i++) {
+        add_thread(d, d->buf1, n1, s->list[i], s->bol, eol);
+    }
+    for (int i = 0; i < *n1; i++) {
+        if (d->prog.insts[d->buf1[i]].op == OP_MATCH) {
+            if (!d->longest) *n1 = i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Work out and cache the transition from state si on byte c */
+static int dfa_step(struct reDfa *d, int si, int c) {
+    int n1, n2 = 0;
+    int matched = dfa_settle(d, si, c == '\n', &n1);
+    int bol = c == '\n';
+    int inject = d->states[si].inject && (d->longest || !matched);
+    
+    d->gen++;
+    for (int i = 0; i < n1; i++) {
+        const struct reInst *in = &d->prog.insts[d->buf1[i]];
+        if (in->op == OP_CLASS && class_has(d->prog.classes[in->cls], c)) {
+            add_thread(d, d->buf2, &n2, in->x, bol, -1);
+        }
+    }
+    if (inject) add_thread(d, d->buf2, &n2, 0, bol, -1);
+    
+    unsigned flushes = d->flushes;
+    int next = dfa_intern(d, d->buf2, n2, inject, bol);
+    int t = (next * 256) << TRANS_SHIFT | (n2 == 0 && !inject ? TRANS_DEAD : 0) |
+            (matched ? TRANS_MATCH : 0);
+    /* a flush takes si with it; the transition is then not cached */
+    if (d->flushes == flushes) d->trans[256 * si + c] = t;
+    return t;
+}
+
+static int dfa_eof(struct reDfa *d, int si, int eol) {
+    struct reState *s = &d->states[si];
+    if (s->eof[eol] < 0) {
+        int n1;
+        s->eof[eol] = dfa_settle(d, si, eol, &n1);
+    }
+    return s->eof[eol];
+}
+
+/* -------- scanning the buffer -------- */
+/* Run forward over [start, end); returns where the last match seen
+ * ends, or the first one if earliest is set */
+static size_t scan_forward(struct reDfa *d, struct gapbuf *g, size_t start, size_t end,
+                           int inject, int earliest) {
+    size_t len = gap_length(g);
+    int bol = start == 0 || gap_char_at(g, start - 1) == '\n';
+    int eol = end == len || gap_char_at(g, end) == '\n';
+    int row = 256 * dfa_start(d, bol, inject);
+    const int *trans = d->trans;
+    size_t last = SEARCH_NONE;
+    size_t pos = start, n;
+    const char *p;
+    
+    while (pos < end && (p = gap_span(g, pos, &n)) != NULL) {
+        if (n > end - pos) n = end - pos;
+        for (size_t i = 0; i < n; i++) {
+            unsigned char c = p[i];
+            int t = trans[row + c];
+            if (t < 0) {
+                /* the table may move as it grows */
+                t = dfa_step(d, row / 256, c);
+                trans = d->trans;
+            }
+            if (t & (TRANS_MATCH | TRANS_DEAD)) {
+                if (t & TRANS_MATCH) last = pos + i;
+                if (earliest && (t & TRANS_MATCH)) return last;
+                if (t & TRANS_DEAD) return last;
+            }
+            row = t >> TRANS_SHIFT;
+        }
+        pos += n;
+    }
+    if (dfa_eof(d, row / 256, eol)) last = end;
+    return last;
+}
+
+/* Run backward over [start, end) with a reversed program; returns the
+ * position where the last match seen starts */
+static size_t scan_backward(struct reDfa *d, struct gapbuf *g, size_t start, size_t end,
+                            int inject, int earliest) {
+    size_t len = gap_length(g);
+    int bol = end == len || gap_char_at(g, end) == '\n';
+    int eol = start == 0 || gap_char_at(g, start - 1) == '\n';
+    int row = 256 * dfa_start(d, bol, inject);
+    const int *trans = d->trans;
+    size_t last = SEARCH_NONE;
+    size_t pos = end, n;
+    const char *p;
+    
+    while (pos > start && (p = gap_span_before(g, pos, &n)) != NULL) {
+        if (n > pos - start) {
+            p += n - (pos - start);
+            n = pos - start;
+        }
+        for (size_t i = n; i-- > 0; ) {
+            unsigned char c = p[i];
+            int t = trans[row + c];
+            if (t < 0) {
+                /* the table may move as it grows */
+                t = dfa_step(d, row / 256, c);
+                trans = d->trans;
+            }
+            if (t & (TRANS_MATCH | TRANS_DEAD)) {
+                if (t & TRANS_MATCH) last = pos - n + i + 1;
+                if (earliest && (t & TRANS_MATCH)) return last;
+                if (t & TRANS_DEAD) return last;
+            }
+            row = t >> TRANS_SHIFT;
+        }
+        pos -= n;
+    }
+    if (dfa_eof(d, row / 256, eol)) last = start;
+    return last;
+}
+
+/* -------- interface -------- */
+static int compile_prog(struct reProg *prog, const struct reParser *p, int root, int reverse) {
+    memset(prog, 0, sizeof(*prog));
+    if (gen(prog, p->nodes, root, reverse) == -1 || prog->n > REGEX_MAX_INSTS) {
+        free(prog->insts);
+        return -1;
+    }
+    emit(prog, OP_MATCH, 0, 0);
+    return 0;
+}
+
+struct regex *regex_compile(const char *pattern, size_t len, const char **error) {
+    struct reParser p;
+    memset(&p, 0, sizeof(p));
+    p.s = pattern;
+    p.len = len;
+    
+    int root = parse_alt(&p);
+    if (root != -1 && p.pos < len) p.error = "unmatched )";
+    struct regex *re = NULL;
+    if (root != -1 && !p.error) {
+        re = malloc(sizeof(struct regex));
+        if (compile_prog(&re->fwd.prog, &p, root, 0) == -1) {
+            p.error = "pattern too large";
+            free(re);
+            re = NULL;
+        } else {
+            compile_prog(&re->rev.prog, &p, root, 1);
+            compile_prog(&re->rev_longest.prog, &p, root, 1);
+        }
+    }
+    free(p.nodes);
+    if (!re) {
+        free(p.classes);
+        *error = p.error ? p.error : "bad pattern";
+        return NULL;
+    }
+    
+    re->classes = p.classes;
+    re->fwd.prog.classes = re->rev.prog.classes = re->rev_longest.prog.classes =
+        (const unsigned char (*)[32])p.classes;
+    dfa_init(&re->fwd, 0);
+    dfa_init(&re->rev, 0);
+    dfa_init(&re->rev_longest, 1);
+    return re;
+}
+
+void regex_free(struct regex *re) {
+    if (!re) return;
+    dfa_free(&re->fwd);
+    dfa_free(&re->rev);
+    dfa_free(&re->rev_longest);
+    free(re->classes);
+    free(re);
+}
+
+size_t regex_search(struct regex *re, struct gapbuf *g, size_t start, size_t end, size_t *mend) {
+    size_t len = gap_length(g);
+    if (end > len) end = len;
+    if (start > end) return SEARCH_NONE;
+    
+    /* the forward pass finds where the match ends, the backward
+     * pass from there finds where it starts */
+    size_t e = scan_forward(&re->fwd, g, start, end, 1, 0);
+    if (e == SEARCH_NONE) return SEARCH_NONE;
+    *mend = e;
+    return scan_backward(&re->rev_longest, g, start, e, 0, 0);
+}
+
+size_t regex_search_backward(struct regex *re, struct gapbuf *g, size_t start, size_t end,
+                             size_t *mend) {
+    size_t len = gap_length(g);
+    if (end > len) end = len;
+    if (start > end) return SEARCH_NONE;
+    
+    size_t s = scan_backward(&re->rev, g, start, end, 1, 1);
+    if (s == SEARCH_NONE) return SEARCH_NONE;
+    *mend = scan_forward(&re->fwd, g, s, end, 0, 0);
+    return s;
+}
@@ -0,0 +1,30 @@
+/* regex.h - Regular-expression search over the buffer */
+#ifndef REGEX_H
+#define REGEX_H
+
+#include <stddef.h>
+#include "search.h"
+
+struct gapbuf;
+struct regex;
+
+/* Compile pattern[0..len). Supported: literals, escaped punctuation,
+ * \n \t \r \f \v \0, ., [...] classes with ranges and ^, \d \w \s \D \W
+ * \S, groups, |, * + ? and {m,n} (lazy with a trailing ?), ^ and $ at
+ * line boundaries; any other letter escape is an error. Returns NULL
+ * and sets *error if the pattern is invalid. */
+struct regex *regex_compile(const char *pattern, size_t len, const char **error);
+
+/* Free a compiled regex and its DFA caches */
+void regex_free(struct regex *re);
+
+/* First match lying within [start, end), chosen as Perl would: the
+ * leftmost, and among those the one the pattern prefers. Returns its
+ * start and sets *mend to its end, or returns SEARCH_NONE. */
+size_t regex_search(struct regex *re, struct gapbuf *g, size_t start, size_t end, size_t *mend);
+
+/* The match starting last among those lying within [start, end) */
+size_t regex_search_backward(struct regex *re, struct gapbuf *g, size_t start, size_t end,
+                             size_t *mend);
+
+#endif /* REGEX_H */
@@ -0,0 +1,272 @@
+/* save.c - Background save implementation */
+#define _XOPEN_SOURCE 700
+
+#include "save.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#define SAVE_IOV_MAX 64
+/* Bytes per writev, small enough for steady progress reports */
+#define SAVE_CHUNK (4 << 20)
+
+void save_init(struct saveJob *job) {
+    pthread_mutex_init(&job->lock, NULL);
+    job->running = 0;
+    job->path = NULL;
+    job->state = SAVE_IDLE;
+    job->written = 0;
+    job->failed = NULL;
+    job->err = 0;
+}
+
+/* fsync the directory holding path so a rename in it is durable */
+static void sync_dir(const char *path) {
+    char *dir = strdup(path);
+    char *slash = strrchr(dir, '/');
+    if (slash) *(slash == dir ? slash + 1 : slash) = '\0';
+    int fd = open(slash ? dir : ".", O_RDONLY);
+    if (fd != -1) {
+        fsync(fd);
+        close(fd);
+    }
+    free(dir);
+}
+
+/* Write every span of the snapshot, reporting progress as it goes */
+static int write_snapshot(struct saveJob *job, int fd) {
+    struct iovec iov[SAVE_IOV_MAX];
+    size_t span = 0, off = 0;
+    unsigned long long hash = GAP_HASH_SEED;
+    
+    while (span < job->snap.nspans) {
+        int cnt = 0;
+        size_t total = 0;
+        size_t s = span, o = off;
+        while (cnt < SAVE_IOV_MAX && s < job->snap.nspans && total < SAVE_CHUNK) {
+            size_t n = job->snap.spans[s].len - o;
+            if (n > SAVE_CHUNK - total) n = SAVE_CHUNK - total;
+            iov[cnt].iov_base = (void *)(job->snap.spans[s].data + o);
+            iov[cnt].iov_len = n;
+            cnt++;
+            total += n;
+            o += n;
+            if (o == job->snap.spans[s].len) {
+                s++;
+                o = 0;
+            }
+        }
+        
+        ssize_t n = writev(fd, iov, cnt);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        size_t hashed = n;
+        for (int i = 0; hashed > 0; i++) {
+            size_t len = iov[i].iov_len < hashed ? iov[i].iov_len : hashed;
+            hash = gap_hash_bytes(hash, iov[i].iov_base, len);
+            hashed -= len;
+        }
+        /* advance past what was written; short writes resume mid-span */
+        for (size_t left = n; left > 0; ) {
+            size_t rest = job->snap.spans[span].len - off;
+            if (left < rest) {
+                off += left;
+                break;
+            }
+            left -= rest;
+            span++;
+            off = 0;
+        }
+        
+        pthread_mutex_lock(&job->lock);
+        job->written += n;
+        pthread_mutex_unlock(&job->lock);
+    }
+    job->hash = hash;
+    return 0;
+}
+
+static int write_all(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Copy the file at from to a new file at to, for filesystems that have
+ * no hard links */
+static int copy_file(const char *from, const char *to, mode_t mode) {
+    int in = open(from, O_RDONLY);
+    if (in == -1) return -1;
+    int out = open(to, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    int ok = out != -1 && fchmod(out, mode) == 0;
+    char buf[65536];
+    while (ok) {
+        ssize_t n = read(in, buf, sizeof(buf));
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) {
+            ok = n == 0;
+            break;
+        }
+        ok = write_all(out, buf, n) == 0;
+    }
+    if (ok && fsync(out) == -1) ok = 0;
+    int err = errno;
+    close(in);
+    if (out != -1 && close(out) == -1 && ok) {
+        ok = 0;
+        err = errno;
+    }
+    if (!ok && out != -1) unlink(to);
+    errno = err;
+    return ok ? 0 : -1;
+}
+
+/* Keep the file at path as path~. It is linked, or copied where that is
+ * not possible, under a scratch name and then renamed, so a failure
+ * leaves the previous backup in place. */
+static int make_backup(const char *path, mode_t mode) {
+    size_t size = strlen(path) + 6;
+    char *backup = malloc(size);
+    char *scratch = malloc(size);
+    snprintf(backup, size, "%s~", path);
+    snprintf(scratch, size, "%s~.new", path);
+    unlink(scratch);
+    int ok = (link(path, scratch) == 0 || copy_file(path, scratch, mode) == 0) &&
+             rename(scratch, backup) == 0;
+    int err = errno;
+    if (!ok) unlink(scratch);
+    free(backup);
+    free(scratch);
+    errno = err;
+    return ok ? 0 : -1;
+}
+
+static void *save_thread(void *arg) {
+    struct saveJob *job = arg;
+    const char *failed = NULL;
+    int err = 0;
+    
+    size_t tmp_size = strlen(job->path) + 8;
+    char *tmp = malloc(tmp_size);
+    snprintf(tmp, tmp_size, "%s.XXXXXX", job->path);
+    
+    struct stat st;
+    int exists = stat(job->path, &st) == 0;
+    
+    int fd = mkstemp(tmp);
+    if (fd == -1) {
+        failed = "create";
+        err = errno;
+    } else {
+        fchmod(fd, exists ? (st.st_mode & 07777) : job->new_mode);
+        if (write_snapshot(job, fd) == -1 || fsync(fd) == -1) {
+            failed = "write";
+            err = errno;
+        }
+        /* the rename keeps the inode, so this describes the saved file */
+        if (fstat(fd, &job->st) == -1) memset(&job->st, 0, sizeof(job->st));
+        if (close(fd) == -1 && !failed) {
+            failed = "write";
+            err = errno;
+        }
+    }
+    
+    if (!failed && exists && job->backup && make_backup(job->path, st.st_mode & 07777) == -1) {
+        failed = "backup";
+        err = errno;
+    }
+    
+    if (!failed && rename(tmp, job->path) == -1) {
+        failed = "rename";
+        err = errno;
+    }
+    
+    if (failed) {
+        if (fd != -1) unlink(tmp);
+    } else {
+        sync_dir(job->path);
+    }
+    free(tmp);
+    
+    pthread_mutex_lock(&job->lock);
+    job->failed = failed;
+    job->err = err;
+    job->state = failed ? SAVE_FAILED : SAVE_DONE;
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+int save_start(struct saveJob *job, struct gapbuf *g, const char *filename, int backup) {
+    /* save through symlinks to the file they point at */
+    job->path = realpath(filename, NULL);
+    if (!job->path) job->path = strdup(filename);
+    job->backup = backup;
+    /* mkstemp creates 0600; a new file gets what open(0666) would give.
+     * The umask can only be read by setting it, so do that here rather
+     * than on the writer thread. */
+    mode_t mask = umask(0);
+    umask(mask);
+    job->new_mode = 0666 & ~mask;
+    job->state = SAVE_RUNNING;
+    job->written = 0;
+    job->failed = NULL;
+    job->err = 0;
+    gap_snapshot(g, &job->snap);
+    
+    int err = pthread_create(&job->thread, NULL, save_thread, job);
+    if (err) {
+        gap_snapshot_release(g, &job->snap);
+        free(job->path);
+        job->path = NULL;
+        job->state = SAVE_IDLE;
+        errno = err;
+        return -1;
+    }
+    job->running = 1;
+    return 0;
+}
+
+/* Join a writer that has finished and free what it used */
+static void save_finish(struct saveJob *job, struct gapbuf *g) {
+    pthread_join(job->thread, NULL);
+    gap_snapshot_release(g, &job->snap);
+    free(job->path);
+    job->path = NULL;
+    job->running = 0;
+}
+
+int save_poll(struct saveJob *job, struct gapbuf *g, size_t *written) {
+    *written = 0;
+    if (!job->running) return SAVE_IDLE;
+    pthread_mutex_lock(&job->lock);
+    int state = job->state;
+    *written = job->written;
+    if (state == SAVE_DONE || state == SAVE_FAILED) job->state = SAVE_IDLE;
+    pthread_mutex_unlock(&job->lock);
+    
+    if (state == SAVE_DONE || state == SAVE_FAILED) save_finish(job, g);
+    return state;
+}
+
+int save_wait(struct saveJob *job, struct gapbuf *g) {
+    if (!job->running) return SAVE_IDLE;
+    save_finish(job, g);
+    int state = job->state;
+    job->state = SAVE_IDLE;
+    return state;
+}
@@ -0,0 +1,51 @@
+/* save.h - Atomic file saves written on a background thread */
+#ifndef SAVE_H
+#define SAVE_H
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "buffer.h"
+
+enum saveState {
+    SAVE_IDLE,
+    SAVE_RUNNING,
+    SAVE_DONE,
+    SAVE_FAILED
+};
+
+struct saveJob {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    struct gapsnap snap;
+    char *path;                 /* file being replaced */
+    int backup;                 /* keep the previous version as path~ */
+    mode_t new_mode;            /* for a file that does not exist yet */
+    unsigned long generation;   /* caller's edit count at the snapshot */
+    struct stat st;             /* the file as written, once done */
+    int running;                /* a writer thread exists; caller's side only */
+    /* shared with the writer thread, under lock */
+    int state;
+    size_t written;
+    unsigned long long hash;    /* gap_hash of what was written */
+    const char *failed;         /* step that failed */
+    int err;
+};
+
+/* Initialize an idle job */
+void save_init(struct saveJob *job);
+
+/* Snapshot g and write it to filename on a writer thread: a temp file
+ * beside the target is fsynced and renamed over it. Returns -1 if the
+ * thread cannot be started. */
+int save_start(struct saveJob *job, struct gapbuf *g, const char *filename, int backup);
+
+/* State of the job; *written is set while it runs. A finished job is
+ * joined and its snapshot released, then reported once as SAVE_DONE or
+ * SAVE_FAILED before going back to SAVE_IDLE. */
+int save_poll(struct saveJob *job, struct gapbuf *g, size_t *written);
+
+/* Block until a running save finishes; returns its final state */
+int save_wait(struct saveJob *job, struct gapbuf *g);
+
+#endif /* SAVE_H */
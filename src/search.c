@@ -0,0 +1,139 @@
+/* search.c - Literal text search over the buffer in place */
+#include "search.h"
+#include "buffer.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Common bytes of source and prose, most frequent first. Bytes not
+ * listed are taken to be rarer than all of these. */
+static const char common_bytes[] =
+    " etaoinsrhldcumfpgwybvkxjqz\n_()=;,.EITSANROLCDUMP{}\"'0123456789*/-+<>:[]#\t";
+
+static int byte_rank(unsigned char c) {
+    const char *p = c ? strchr(common_bytes, c) : NULL;
+    return p ? (int)(p - common_bytes) : (int)sizeof(common_bytes);
+}
+
+void search_compile(struct searchPattern *p, const char *text, size_t len) {
+    p->text = malloc(len ? len : 1);
+    /* an empty query may come with no text at all */
+    if (len) memcpy(p->text, text, len);
+    p->len = len;
+    p->window = malloc(len ? 2 * len : 1);
+    
+    p->rare = 0;
+    for (size_t i = 1; i < len; i++) {
+        if (byte_rank(text[i]) > byte_rank(text[p->rare])) p->rare = i;
+    }
+    for (int c = 0; c < 256; c++) {
+        p->fskip[c] = len;
+        p->bskip[c] = len;
+    }
+    for (size_t i = 0; i + 1 < len; i++) {
+        p->fskip[(unsigned char)text[i]] = len - 1 - i;
+    }
+    for (size_t i = len; i-- > 1; ) {
+        p->bskip[(unsigned char)text[i]] = i;
+    }
+}
+
+void search_free(struct searchPattern *p) {
+    free(p->text);
+    free(p->window);
+    p->text = p->window = NULL;
+    p->len = 0;
+}
+
+/* -------- kernels -------- */
+/* First match in s[0..len) */
+static size_t scan_forward(const struct searchPattern *p, const char *s, size_t len) {
+    size_t n = p->len;
+    if (len < n) return SEARCH_NONE;
+    size_t last = len - n;
+    size_t i = 0;
+    while (i <= last) {
+        const char *q = memchr(s + i + p->rare, p->text[p->rare], last - i + 1);
+        if (!q) return SEARCH_NONE;
+        i = q - s - p->rare;
+        if (memcmp(s + i, p->text, n) == 0) return i;
+        i += p->fskip[(unsigned char)s[i + n - 1]];
+    }
+    return SEARCH_NONE;
+}
+
+/* Last match in s[0..len) */
+static size_t scan_backward(const struct searchPattern *p, const char *s, size_t len) {
+    size_t n = p->len;
+    if (len < n) return SEARCH_NONE;
+    size_t i = len - n;
+    for (;;) {
+        if (s[i] == p->text[0] && memcmp(s + i, p->text, n) == 0) return i;
+        size_t shift = p->bskip[(unsigned char)s[i]];
+        if (i < shift) return SEARCH_NONE;
+        i -= shift;
+    }
+}
+
+/* Copy the text around boundary into the window: every match found
+ * there starts before boundary and ends after it */
+static size_t load_window(struct searchPattern *p, struct gapbuf *g, size_t boundary,
+                          size_t start, size_t end, size_t *ws) {
+    size_t n = p->len;
+    *ws = boundary - start > n - 1 ? boundary - (n - 1) : start;
+    size_t we = end - boundary > n - 1 ? boundary + (n - 1) : end;
+    gap_copy_range(g, *ws, we, p->window);
+    return we - *ws;
+}
+
+/* -------- searching the buffer -------- */
+size_t search_forward(struct searchPattern *p, struct gapbuf *g, size_t start, size_t end) {
+    size_t n = p->len;
+    if (end > gap_length(g)) end = gap_length(g);
+    if (n == 0) return SEARCH_NONE;
+    
+    size_t pos = start, len, ws;
+    const char *s;
+    while (pos + n <= end && (s = gap_span(g, pos, &len)) != NULL) {
+        if (len > end - pos) len = end - pos;
+        size_t hit = scan_forward(p, s, len);
+        if (hit != SEARCH_NONE) return pos + hit;
+        
+        pos += len;
+        if (n > 1 && pos < end) {
+            size_t wlen = load_window(p, g, pos, start, end, &ws);
+            hit = scan_forward(p, p->window, wlen);
+            if (hit != SEARCH_NONE) return ws + hit;
+        }
+    }
+    return SEARCH_NONE;
+}
+
+size_t search_backward(struct searchPattern *p, struct gapbuf *g, size_t start, size_t end) {
+    size_t n = p->len;
+    if (end > gap_length(g)) end = gap_length(g);
+    if (n == 0) return SEARCH_NONE;
+    
+    size_t pos = end, len, ws;
+    const char *s;
+    while (pos >= start + n && (s = gap_span_before(g, pos, &len)) != NULL) {
+        if (len > pos - start) {
+            s += len - (pos - start);
+            len = pos - start;
+        }
+        size_t hit = scan_backward(p, s, len);
+        if (hit != SEARCH_NONE) return pos - len + hit;
+        
+        pos -= len;
+        if (n > 1 && pos > start) {
+            size_t wlen = load_window(p, g, pos, start, end, &ws);
+            hit = scan_backward(p, p->window, wlen);
+            if (hit != SEARCH_NONE) return ws + hit;
+        }
+    }
+    return SEARCH_NONE;
+}
+
+size_t search_bytes(const struct searchPattern *p, const char *text, size_t len) {
+    if (p->len == 0) return SEARCH_NONE;
+    return scan_forward(p, text, len);
+}
@@ -0,0 +1,41 @@
+/* search.h - Literal text search over the buffer in place */
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stddef.h>
+
+struct gapbuf;
+
+#define SEARCH_NONE ((size_t)-1)
+
+/* A compiled search string. Candidates are found with memchr on the
+ * needle byte least likely to be common in text, then checked with
+ * memcmp; a mismatch shifts by the Horspool table. */
+struct searchPattern {
+    char *text;
+    size_t len;
+    size_t rare;            /* index of the byte memchr looks for */
+    size_t fskip[256];      /* shift on the byte under a window's end */
+    size_t bskip[256];      /* shift on the byte under a window's start */
+    char *window;           /* text around a span boundary */
+};
+
+/* Compile text[0..len) for searching */
+void search_compile(struct searchPattern *p, const char *text, size_t len);
+
+/* Free what search_compile allocated */
+void search_free(struct searchPattern *p);
+
+/* First match lying within [start, end), or SEARCH_NONE. The buffer
+ * is read a span at a time without copying; only the few bytes around
+ * span boundaries are copied to catch matches across the gap. */
+size_t search_forward(struct searchPattern *p, struct gapbuf *g, size_t start, size_t end);
+
+/* Last match lying within [start, end), or SEARCH_NONE */
+size_t search_backward(struct searchPattern *p, struct gapbuf *g, size_t start, size_t end);
+
+/* First match in text[0..len), for text outside the buffer such as a
+ * mapped file. Only reads p, so threads may share one pattern. */
+size_t search_bytes(const struct searchPattern *p, const char *text, size_t len);
+
+#endif /* SEARCH_H */
@@ -5,13 +5,13 @@
 #include <stdlib.h>
 #include <string.h>
 
-void selection_start(struct selection *sel, int row, int col) {
+void selection_start(struct selection *sel, size_t row, size_t col) {
     sel->active = 1;
     sel->start_row = sel->end_row = row;
     sel->start_col = sel->end_col = col;
 }
 
-void selection_update(struct selection *sel, int row, int col) {
+void selection_update(struct selection *sel, size_t row, size_t col) {
     sel->end_row = row;
     sel->end_col = col;
 }
@@ -20,15 +20,15 @@ void selection_clear(struct selection *sel) {
     sel->active = 0;
 }
 
-int selection_contains(struct selection *sel, int row, int col) {
+int selection_contains(struct selection *sel, size_t row, size_t col) {
     if (!sel->active) return 0;
     
-    int sr = sel->start_row, sc = sel->start_col;
-    int er = sel->end_row, ec = sel->end_col;
+    size_t sr = sel->start_row, sc = sel->start_col;
+    size_t er = sel->end_row, ec = sel->end_col;
     
     // Normalize
     if (sr > er || (sr == er && sc > ec)) {
-        int tmp = sr; sr = er; er = tmp;
+        size_t tmp = sr; sr = er; er = tmp;
         tmp = sc; sc = ec; ec = tmp;
     }
     
@@ -39,83 +39,53 @@ int selection_contains(struct selection *sel, int row, int col) {
     return 1;
 }
 
-void pos_to_rowcol(struct gapbuf *g, int pos, int *row, int *col) {
-    *row = 0;
-    *col = 0;
-    for (int i = 0; i < pos; i++) {
-        char c = gap_char_at(g, i);
-        if (c == '\n') {
-            (*row)++;
-            *col = 0;
-        } else {
-            (*col)++;
-        }
-    }
+void pos_to_rowcol(struct gapbuf *g, size_t pos, size_t *row, size_t *col) {
+    size_t len = gap_length(g);
+    if (pos > len) pos = len;
+    *row = gap_line_of(g, pos);
+    *col = pos - gap_line_start(g, *row);
 }
 
-int rowcol_to_pos(struct gapbuf *g, int row, int col) {
-    int pos = 0;
-    int cur_row = 0;
-    int cur_col = 0;
-    int len = gap_length(g);
-    
-    while (pos < len && cur_row < row) {
-        if (gap_char_at(g, pos) == '\n') {
-            cur_row++;
-            cur_col = 0;
-        } else {
-            cur_col++;
-        }
-        pos++;
-    }
-    
-    while (pos < len && cur_col < col) {
-        char c = gap_char_at(g, pos);
-        if (c == '\n') break;
-        cur_col++;
-        pos++;
-    }
-    
-    return pos;
+size_t rowcol_to_pos(struct gapbuf *g, size_t row, size_t col) {
+    if (row >= gap_lines_upto(g, row + 1)) return gap_length(g);
+    size_t start = gap_line_start(g, row);
+    size_t line_len = gap_line_end(g, row) - start;
+    if (col > line_len) col = line_len;
+    return start + col;
 }
 
 void clipboard_copy(struct clipboard *clip, struct selection *sel, struct gapbuf *g) {
     if (!sel->active) return;
     
-    int sr = sel->start_row, sc = sel->start_col;
-    int er = sel->end_row, ec = sel->end_col;
+    size_t sr = sel->start_row, sc = sel->start_col;
+    size_t er = sel->end_row, ec = sel->end_col;
     
     // Normalize
     if (sr > er || (sr == er && sc > ec)) {
-        int tmp = sr; sr = er; er = tmp;
+        size_t tmp = sr; sr = er; er = tmp;
         tmp = sc; sc = ec; ec = tmp;
     }
     
-    int start_pos = rowcol_to_pos(g, sr, sc);
-    int end_pos = rowcol_to_pos(g, er, ec);
-    int copy_len = end_pos - start_pos;
-    
-    if (copy_len <= 0) return;
+    size_t start_pos = rowcol_to_pos(g, sr, sc);
+    size_t end_pos = rowcol_to_pos(g, er, ec);
+    if (end_pos <= start_pos) return;
+    size_t copy_len = end_pos - start_pos;
     
     clipboard_free(clip);
     clip->data = malloc(copy_len + 1);
     clip->len = copy_len;
-    
-    for (int i = 0; i < copy_len; i++) {
-        clip->data[i] = gap_char_at(g, start_pos + i);
-    }
+    gap_copy_range(g, start_pos, end_pos, clip->data);
     clip->data[copy_len] = '\0';
 }
 
-void clipboard_paste(struct clipboard *clip, struct gapbuf *g, int pos, struct editHistory *hist) {
+void clipboard_paste(struct clipboard *clip, struct gapbuf *g, size_t pos, struct editHistory *hist) {
     if (!clip->data || clip->len == 0) return;
     
     gap_move(g, pos);
-    
-    for (int i = 0; i < clip->len; i++) {
-        gap_insert(g, clip->data[i]);
-        history_push(hist, EDIT_INSERT, pos + i, clip->data[i]);
-    }
+    gap_insert_n(g, clip->data, clip->len);
+    history_begin(hist);
+    history_push_n(hist, EDIT_INSERT, pos, clip->data, clip->len);
+    history_end(hist);
 }
 
 void clipboard_free(struct clipboard *clip) {
@@ -127,22 +97,27 @@ void clipboard_free(struct clipboard *clip) {
 void selection_delete(struct selection *sel, struct gapbuf *g, struct editHistory *hist) {
     if (!sel->active) return;
     
-    int sr = sel->start_row, sc = sel->start_col;
-    int er = sel->end_row, ec = sel->end_col;
+    size_t sr = sel->start_row, sc = sel->start_col;
+    size_t er = sel->end_row, ec = sel->end_col;
     
     if (sr > er || (sr == er && sc > ec)) {
-        int tmp = sr; sr = er; er = tmp;
+        size_t tmp = sr; sr = er; er = tmp;
         tmp = sc; sc = ec; ec = tmp;
     }
     
-    int start_pos = rowcol_to_pos(g, sr, sc);
-    int end_pos = rowcol_to_pos(g, er, ec);
+    size_t start_pos = rowcol_to_pos(g, sr, sc);
+    size_t end_pos = rowcol_to_pos(g, er, ec);
     
     gap_move(g, start_pos);
-    for (int i = start_pos; i < end_pos; i++) {
-        char ch = gap_char_at(g, start_pos);
-        gap_delete(g);
-        history_push(hist, EDIT_DELETE, start_pos, ch);
+    if (end_pos > start_pos) {
+        size_t n = end_pos - start_pos;
+        char *text = malloc(n);
+        gap_copy_range(g, start_pos, end_pos, text);
+        gap_delete_range(g, start_pos, end_pos);
+        history_begin(hist);
+        history_push_n(hist, EDIT_DELETE, start_pos, text, n);
+        history_end(hist);
+        free(text);
     }
     
     selection_clear(sel);
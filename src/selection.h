@@ -2,32 +2,34 @@
 #ifndef SELECTION_H
 #define SELECTION_H
 
+#include <stddef.h>
+
 // Forward declarations
 struct gapbuf;
 struct editHistory;
 
 struct selection {
     int active;
-    int start_row, start_col;
-    int end_row, end_col;
+    size_t start_row, start_col;
+    size_t end_row, end_col;
 };
 
 struct clipboard {
     char *data;
-    int len;
+    size_t len;
 };
 
-void selection_start(struct selection *sel, int row, int col);
-void selection_update(struct selection *sel, int row, int col);
+void selection_start(struct selection *sel, size_t row, size_t col);
+void selection_update(struct selection *sel, size_t row, size_t col);
 void selection_clear(struct selection *sel);
-int selection_contains(struct selection *sel, int row, int col);
+int selection_contains(struct selection *sel, size_t row, size_t col);
 
 void clipboard_copy(struct clipboard *clip, struct selection *sel, struct gapbuf *g);
-void clipboard_paste(struct clipboard *clip, struct gapbuf *g, int pos, struct editHistory *hist);
+void clipboard_paste(struct clipboard *clip, struct gapbuf *g, size_t pos, struct editHistory *hist);
 void clipboard_free(struct clipboard *clip);
 void selection_delete(struct selection *sel, struct gapbuf *g, struct editHistory *hist);
 
-int rowcol_to_pos(struct gapbuf *g, int row, int col);
-void pos_to_rowcol(struct gapbuf *g, int pos, int *row, int *col);
+size_t rowcol_to_pos(struct gapbuf *g, size_t row, size_t col);
+void pos_to_rowcol(struct gapbuf *g, size_t pos, size_t *row, size_t *col);
 
 #endif /* SELECTION_H */
@@ -1,73 +1,288 @@
 /* syntax.c - Syntax highlighting implementation */
 #include "syntax.h"
+#include "buffer.h"
+#include "lang.h"
+#include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 
-int is_separator(int c) {
-    return isspace(c) || c == '\0' || strchr(",.()+-/*=~%<>[];", c) != NULL;
+/* Lexer states carried across line ends */
+#define HLS_NORMAL  0
+#define HLS_COMMENT 1   /* inside a block comment */
+#define HLS_STRING  2   /* inside a string; HLS_STRING + quote index */
+
+/* Find needle in s[0..len), or NULL */
+static const char *find_delim(const char *s, int len, const char *needle, int nlen) {
+    const char *end = s + len - nlen + 1;
+    while (s < end) {
+        s = memchr(s, needle[0], end - s);
+        if (!s) return NULL;
+        if (memcmp(s, needle, nlen) == 0) return s;
+        s++;
+    }
+    return NULL;
 }
 
-enum editorHighlight get_highlight(const char *content, int len, int pos, const char *filename) {
-    if (pos >= len) return HL_NORMAL;
+int syntax_lex_line(const struct language *lang, const char *s, int len, int state,
+                    unsigned char *hl) {
+    int block_len = strlen(lang->block_end);
+    int cont = 0;
+    int i = 0;
     
-    // Determine file type
-    int is_c = 0;
-    if (filename) {
-        char *ext = strrchr(filename, '.');
-        if (ext && (strcmp(ext, ".c") == 0 || strcmp(ext, ".h") == 0 || 
-                    strcmp(ext, ".cpp") == 0 || strcmp(ext, ".cc") == 0)) {
-            is_c = 1;
+    while (i < len) {
+        if (state == HLS_COMMENT) {
+            const char *end = find_delim(s + i, len - i, lang->block_end, block_len);
+            int stop = end ? (int)(end - s) + block_len : len;
+            memset(hl + i, HL_COMMENT, stop - i);
+            if (end) state = HLS_NORMAL;
+            i = stop;
+            continue;
+        }
+        
+        if (state >= HLS_STRING) {
+            char quote = lang->quotes[state - HLS_STRING];
+            while (i < len) {
+                char c = s[i];
+                hl[i] = HL_STRING;
+                if (lang->escape && c == lang->escape) {
+                    if (i + 1 < len) hl[i + 1] = HL_STRING;
+                    else cont = 1;
+                    i += 2;
+                    continue;
+                }
+                i++;
+                if (c == quote) {
+                    state = HLS_NORMAL;
+                    break;
+                }
+            }
+            continue;
         }
+        
+        /* longest match of the token DFA starting here */
+        int st = 0, kind = TOK_NONE, end = i;
+        for (int j = i; j < len; j++) {
+            st = lang->next[st * lang->nclasses + lang->cls[(unsigned char)s[j]]];
+            if (st < 0) break;
+            if (lang->accept[st]) {
+                kind = lang->accept[st];
+                end = j + 1;
+            }
+        }
+        
+        switch (kind) {
+            case TOK_NONE:
+                hl[i++] = HL_NORMAL;
+                continue;
+            case TOK_IDENT:
+                memset(hl + i, HL_NORMAL, end - i);
+                break;
+            case TOK_KEYWORD:
+                memset(hl + i, HL_KEYWORD, end - i);
+                break;
+            case TOK_TYPE:
+                memset(hl + i, HL_TYPE, end - i);
+                break;
+            case TOK_NUMBER:
+                memset(hl + i, HL_NUMBER, end - i);
+                break;
+            case TOK_LINE_COMMENT:
+                memset(hl + i, HL_COMMENT, len - i);
+                end = len;
+                break;
+            case TOK_BLOCK_COMMENT:
+                memset(hl + i, HL_COMMENT, end - i);
+                state = HLS_COMMENT;
+                break;
+            default:
+                memset(hl + i, HL_STRING, end - i);
+                state = HLS_STRING + (kind - TOK_STRING);
+                break;
+        }
+        i = end;
     }
     
-    if (!is_c) return HL_NORMAL;
-    
-    char c = content[pos];
+    /* strings end with the line unless multi-line or escaped */
+    if (state >= HLS_STRING && !cont && !lang->multiline[state - HLS_STRING]) {
+        state = HLS_NORMAL;
+    }
+    return state;
+}
+
+/* -------- line cache -------- */
+static char *line_scratch = NULL;
+static size_t line_scratch_cap = 0;
+static unsigned char *hl_scratch = NULL;
+static size_t hl_scratch_cap = 0;
+
+static size_t cache_lines(struct hlCache *c) {
+    return c->cap - (c->gap_end - c->gap_start);
+}
+
+static struct hlLine *line_at(struct hlCache *c, size_t row) {
+    if (row < c->gap_start) return &c->lines[row];
+    return &c->lines[c->gap_end + (row - c->gap_start)];
+}
+
+static void cache_move_gap(struct hlCache *c, size_t row) {
+    if (row < c->gap_start) {
+        size_t n = c->gap_start - row;
+        c->gap_end -= n;
+        memmove(c->lines + c->gap_end, c->lines + row, n * sizeof(struct hlLine));
+        c->gap_start = row;
+    } else if (row > c->gap_start) {
+        size_t n = row - c->gap_start;
+        memmove(c->lines + c->gap_start, c->lines + c->gap_end, n * sizeof(struct hlLine));
+        c->gap_start += n;
+        c->gap_end += n;
+    }
+}
+
+/* Replace `remove` lines at row with `add` stale lines */
+static void cache_replace(struct hlCache *c, size_t row, size_t remove, size_t add) {
+    cache_move_gap(c, row);
+    for (size_t i = 0; i < remove; i++) {
+        free(c->lines[c->gap_end].spans);
+        c->gap_end++;
+    }
     
-    // Check for comment
-    if (pos + 1 < len && content[pos] == '/' && content[pos + 1] == '/') {
-        return HL_COMMENT;
+    if (c->gap_end - c->gap_start < add) {
+        size_t suffix = c->cap - c->gap_end;
+        size_t newcap = c->cap + c->cap / 2;
+        if (newcap < c->gap_start + suffix + add) newcap = c->gap_start + suffix + add;
+        struct hlLine *nl = malloc(newcap * sizeof(struct hlLine));
+        if (c->gap_start) memcpy(nl, c->lines, c->gap_start * sizeof(struct hlLine));
+        if (suffix) memcpy(nl + newcap - suffix, c->lines + c->gap_end, suffix * sizeof(struct hlLine));
+        free(c->lines);
+        c->lines = nl;
+        c->gap_end = newcap - suffix;
+        c->cap = newcap;
     }
     
-    // Numbers
-    if (isdigit(c)) {
-        if (pos == 0 || is_separator(content[pos - 1])) {
-            return HL_NUMBER;
-        }
+    for (size_t i = 0; i < add; i++) {
+        struct hlLine *l = &c->lines[c->gap_start++];
+        l->start = l->end = -1;
+        l->nspans = -1;
+        l->spans = NULL;
     }
+}
+
+void syntax_init(struct hlCache *c) {
+    c->cap = 64;
+    c->lines = malloc(c->cap * sizeof(struct hlLine));
+    c->gap_start = 0;
+    c->gap_end = c->cap;
+    c->valid = c->known = c->dirty_end = 0;
+    c->lang = NULL;
+    cache_replace(c, 0, 0, 1);
+}
+
+void syntax_select(struct hlCache *c, const char *filename) {
+    c->lang = lang_for_file(filename);
+}
+
+void syntax_free(struct hlCache *c) {
+    size_t n = cache_lines(c);
+    for (size_t i = 0; i < n; i++) free(line_at(c, i)->spans);
+    free(c->lines);
+    c->lines = NULL;
+}
+
+void syntax_update(struct hlCache *c, struct gapbuf *g) {
+    size_t lo, hi;
+    if (!gap_take_changes(g, &lo, &hi)) return;
+    /* plain text keeps no per-line state, which matters for huge files */
+    if (!c->lang) return;
     
-    // Strings
-    static int in_string = 0;
-    if (c == '"') in_string = !in_string;
-    if (in_string) return HL_STRING;
+    size_t lo_row = gap_line_of(g, lo);
+    size_t hi_row = gap_line_of(g, hi);
+    size_t new_lines = gap_line_count(g), old_lines = cache_lines(c);
+    size_t old_hi_row = hi_row + old_lines - new_lines;
     
-    // Keywords
-    static const char *keywords[] = {
-        "if", "else", "while", "for", "return", "int", "char", "void",
-        "struct", "enum", "static", "const", "break", "continue", "switch",
-        "case", "default", "sizeof", "typedef", NULL
-    };
+    /* rows below the edit keep their states; remember how far they
+     * were known to be correct so lexing can skip ahead once the
+     * edited rows end in the same state as before */
+    c->known = c->valid > old_hi_row ? c->valid + new_lines - old_lines : lo_row;
+    if (c->valid > lo_row) c->valid = lo_row;
+    c->dirty_end = hi_row + 1;
     
-    for (int i = 0; keywords[i]; i++) {
-        int klen = strlen(keywords[i]);
-        if (pos + klen <= len && memcmp(content + pos, keywords[i], klen) == 0) {
-            if (pos + klen >= len || is_separator(content[pos + klen])) {
-                if (pos == 0 || is_separator(content[pos - 1])) {
-                    return HL_KEYWORD;
-                }
-            }
+    cache_replace(c, lo_row, old_hi_row - lo_row + 1, hi_row - lo_row + 1);
+}
+
+/* Lex one row from the given start state, optionally keeping spans */
+static void lex_row(struct hlCache *c, struct gapbuf *g, size_t row, int start, int keep) {
+    size_t ls = gap_line_start(g, row);
+    size_t le = gap_line_end(g, row);
+    int len = le - ls;
+    const char *text = gap_text(g, ls, le, &line_scratch, &line_scratch_cap);
+    
+    if (hl_scratch_cap < (size_t)len) {
+        hl_scratch_cap = len;
+        hl_scratch = realloc(hl_scratch, hl_scratch_cap);
+    }
+    
+    struct hlLine *l = line_at(c, row);
+    l->start = start;
+    l->end = syntax_lex_line(c->lang, text, len, start, hl_scratch);
+    free(l->spans);
+    l->spans = NULL;
+    l->nspans = -1;
+    if (!keep) return;
+    
+    int n = 0;
+    for (int i = 0; i < len; i++) {
+        if (i == 0 || hl_scratch[i] != hl_scratch[i - 1]) n++;
+    }
+    l->spans = malloc((n ? n : 1) * sizeof(struct hlSpan));
+    l->nspans = 0;
+    for (int i = 0; i < len; i++) {
+        if (i == 0 || hl_scratch[i] != hl_scratch[i - 1]) {
+            l->spans[l->nspans].hl = hl_scratch[i];
+            l->spans[l->nspans].len = 0;
+            l->nspans++;
         }
+        l->spans[l->nspans - 1].len++;
     }
+}
+
+/* Make rows [0, row) valid */
+static void cache_validate(struct hlCache *c, struct gapbuf *g, size_t row) {
+    while (c->valid < row) {
+        size_t r = c->valid;
+        int start = r ? line_at(c, r - 1)->end : HLS_NORMAL;
+        struct hlLine *l = line_at(c, r);
+        if (l->start == start) {
+            /* unchanged line, unchanged input: the old states still hold */
+            if (r >= c->dirty_end && c->known > r) c->valid = c->known;
+            else c->valid++;
+            continue;
+        }
+        lex_row(c, g, r, start, 0);
+        c->valid++;
+    }
+}
+
+const struct hlSpan *syntax_row(struct hlCache *c, struct gapbuf *g, size_t row, int *nspans) {
+    *nspans = 0;
+    if (!c->lang) return NULL;
+    if (row >= cache_lines(c)) return NULL;
+    
+    cache_validate(c, g, row);
+    int start = row ? line_at(c, row - 1)->end : HLS_NORMAL;
+    struct hlLine *l = line_at(c, row);
+    if (l->start != start || l->nspans < 0) lex_row(c, g, row, start, 1);
+    if (c->valid == row) c->valid++;
     
-    return HL_NORMAL;
+    *nspans = l->nspans;
+    return l->spans;
 }
 
-const char* highlight_to_color(enum editorHighlight hl) {
+int highlight_to_color(enum editorHighlight hl) {
     switch (hl) {
-        case HL_KEYWORD: return "\x1b[33m";  // Yellow
-        case HL_STRING:  return "\x1b[32m";  // Green
-        case HL_COMMENT: return "\x1b[36m";  // Cyan
-        case HL_NUMBER:  return "\x1b[31m";  // Red
-        default:         return "\x1b[37m";  // White
+        case HL_KEYWORD: return 33;  // Yellow
+        case HL_STRING:  return 32;  // Green
+        case HL_COMMENT: return 36;  // Cyan
+        case HL_NUMBER:  return 31;  // Red
+        case HL_TYPE:    return 35;  // Magenta
+        default:         return 37;  // White
     }
 }
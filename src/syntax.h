@@ -2,21 +2,70 @@
 #ifndef SYNTAX_H
 #define SYNTAX_H
 
+#include <stddef.h>
+
+struct gapbuf;
+struct language;
+
 enum editorHighlight {
     HL_NORMAL = 0,
     HL_KEYWORD,
     HL_STRING,
     HL_COMMENT,
-    HL_NUMBER
+    HL_NUMBER,
+    HL_TYPE
+};
+
+/* Run of identically highlighted bytes */
+struct hlSpan {
+    int len;
+    unsigned char hl;
+};
+
+/* Cached highlighting for one line */
+struct hlLine {
+    signed char start;      /* lexer state at line start, -1 if stale */
+    signed char end;        /* lexer state at line end */
+    int nspans;             /* -1 when spans are not cached */
+    struct hlSpan *spans;
 };
 
-/* Get highlight type for character at position */
-enum editorHighlight get_highlight(const char *content, int len, int pos, const char *filename);
+/* Per-buffer highlight cache: a gap array of lines indexed by row.
+ * Edits re-lex from the first changed row until the line states agree
+ * with what was cached before, and scrolling reuses cached spans. */
+struct hlCache {
+    struct hlLine *lines;
+    size_t cap;
+    size_t gap_start;
+    size_t gap_end;
+    size_t valid;           /* rows [0, valid) have correct end states */
+    size_t known;           /* rows that were valid before the last edit */
+    size_t dirty_end;       /* first row after the last edited range */
+    const struct language *lang;    /* resolved once per buffer */
+};
+
+/* Initialize an empty cache (one empty line) */
+void syntax_init(struct hlCache *c);
+
+/* Pick the language definition for the buffer's filename */
+void syntax_select(struct hlCache *c, const char *filename);
+
+/* Free all cached lines */
+void syntax_free(struct hlCache *c);
+
+/* Apply edits recorded in the buffer since the last update */
+void syntax_update(struct hlCache *c, struct gapbuf *g);
+
+/* Highlight spans for a row, lexing only lines whose state changed.
+ * Returns NULL (and *nspans = 0) for files without highlighting. */
+const struct hlSpan *syntax_row(struct hlCache *c, struct gapbuf *g, size_t row, int *nspans);
 
-/* Get ANSI color code for highlight type */
-const char* highlight_to_color(enum editorHighlight hl);
+/* Highlight one line starting in lexer state `state`. Fills hl[0..len)
+ * and returns the state at the end of the line. */
+int syntax_lex_line(const struct language *lang, const char *s, int len, int state,
+                    unsigned char *hl);
 
-/* Check if character is a separator */
-int is_separator(int c);
+/* Get ANSI foreground color code (30-37) for highlight type */
+int highlight_to_color(enum editorHighlight hl);
 
 #endif /* SYNTAX_H */
@@ -0,0 +1,64 @@
+/* model.c - A document kept as a plain string, to check buffers against */
+#define _POSIX_C_SOURCE 200809L
+
+#include "model.h"
+#include <stdlib.h>
+#include <string.h>
+
+char *model;
+size_t model_len;
+
+void model_set(const char *s, size_t len) {
+    free(model);
+    model = malloc(len + 1);
+    if (len) memcpy(model, s, len);
+    model_len = len;
+}
+
+void model_insert(size_t pos, const char *s, size_t n) {
+    model = realloc(model, model_len + n + 1);
+    memmove(model + pos + n, model + pos, model_len - pos);
+    memcpy(model + pos, s, n);
+    model_len += n;
+}
+
+void model_delete(size_t pos, size_t n) {
+    memmove(model + pos, model + pos + n, model_len - pos - n);
+    model_len -= n;
+}
+
+size_t model_lines(void) {
+    size_t n = 1;
+    for (size_t i = 0; i < model_len; i++) n += model[i] == '\n';
+    return n;
+}
+
+size_t model_line_start(size_t row) {
+    size_t k = 0;
+    if (row == 0) return 0;
+    for (size_t i = 0; i < model_len; i++) {
+        if (model[i] == '\n' && ++k == row) return i + 1;
+    }
+    return model_len;
+}
+
+size_t model_line_of(size_t pos) {
+    size_t n = 0;
+    for (size_t i = 0; i < pos; i++) n += model[i] == '\n';
+    return n;
+}
+
+int model_equals(struct gapbuf *g) {
+    if (gap_length(g) != model_len) return 0;
+    char *text = malloc(model_len + 1);
+    gap_get(g, text, model_len + 1);
+    int same = memcmp(text, model, model_len) == 0;
+    free(text);
+    return same;
+}
+
+void model_free(void) {
+    free(model);
+    model = NULL;
+    model_len = 0;
+}
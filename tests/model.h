@@ -0,0 +1,36 @@
+/* model.h - A document kept as a plain string, to check buffers against */
+#ifndef TEST_MODEL_H
+#define TEST_MODEL_H
+
+#include <stddef.h>
+#include "buffer.h"
+
+/* The document; edit it only through the functions below */
+extern char *model;
+extern size_t model_len;
+
+/* Replace the document with s[0..len) */
+void model_set(const char *s, size_t len);
+
+/* Insert s[0..n) at pos */
+void model_insert(size_t pos, const char *s, size_t n);
+
+/* Delete n bytes at pos */
+void model_delete(size_t pos, size_t n);
+
+/* Number of lines (newlines + 1) */
+size_t model_lines(void);
+
+/* Position of the first character of row, or the end past the last */
+size_t model_line_start(size_t row);
+
+/* Row holding pos */
+size_t model_line_of(size_t pos);
+
+/* Whether g holds exactly the document */
+int model_equals(struct gapbuf *g);
+
+/* Free the document */
+void model_free(void);
+
+#endif /* TEST_MODEL_H */
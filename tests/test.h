@@ -0,0 +1,20 @@
+/* test.h - Helpers shared by the tests */
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+extern int test_failures;
+
+/* Report a failed condition and carry on with the test */
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        test_failures++; \
+    } \
+} while (0)
+
+/* Exit status for main: nonzero if any check failed */
+#define TEST_RESULT() (test_failures ? (fprintf(stderr, "%d checks failed\n", test_failures), 1) : 0)
+
+#endif /* TEST_H */
@@ -0,0 +1,119 @@
+/* test_buffer.c - Gap buffer edits and newline index against a string model */
+#define _POSIX_C_SOURCE 200809L
+
+#include "buffer.h"
+#include "test.h"
+#include "model.h"
+#include <stdlib.h>
+
+int test_failures;
+
+/* Compare every line query with the model; rows on both sides of the
+ * gap are covered since the gap sits wherever the last edit was */
+static void check_lines(struct gapbuf *g) {
+    size_t lines = model_lines();
+    CHECK(gap_line_count(g) == lines);
+    CHECK(gap_lines_upto(g, 1) == 1);
+    size_t count;
+    CHECK(gap_line_count_ready(g, &count) && count == lines);
+    
+    size_t row = 0, start = 0;
+    for (size_t i = 0; i <= model_len; i++) {
+        if (i == model_len || model[i] == '\n') {
+            CHECK(gap_line_start(g, row) == start);
+            CHECK(gap_line_end(g, row) == i);
+            row++;
+            start = i + 1;
+        }
+    }
+    CHECK(gap_line_start(g, lines) == model_len);
+    
+    row = 0;
+    for (size_t i = 0; i <= model_len; i++) {
+        CHECK(gap_line_of(g, i) == row);
+        if (i < model_len && model[i] == '\n') row++;
+    }
+}
+
+static void test_line_index(void) {
+    struct gapbuf g;
+    gap_init(&g, 16);
+    gap_load(&g, "one\ntwo\n\nfour", 13);
+    model_set("one\ntwo\n\nfour", 13);
+    check_lines(&g);
+    
+    /* newlines before and after the gap */
+    gap_move(&g, 5);
+    check_lines(&g);
+    gap_insert(&g, '\n');
+    model_insert(5, "\n", 1);
+    check_lines(&g);
+    gap_move(&g, 0);
+    check_lines(&g);
+    gap_move(&g, model_len);
+    check_lines(&g);
+    
+    /* Backspace and Delete of a newline at either side of the gap */
+    gap_move(&g, 4);
+    CHECK(gap_backspace(&g));
+    model_delete(3, 1);
+    check_lines(&g);
+    CHECK(gap_delete(&g));
+    model_delete(3, 1);
+    check_lines(&g);
+    
+    gap_delete_range(&g, 2, 8);
+    model_delete(2, 6);
+    check_lines(&g);
+    CHECK(model_equals(&g));
+    gap_free(&g);
+}
+
+static void test_random_edits(void) {
+    struct gapbuf g;
+    gap_init(&g, 16);
+    model_set("", 0);
+    srand(1);
+    for (int op = 0; op < 4000; op++) {
+        size_t pos = rand() % (model_len + 1);
+        int r = rand() % 8;
+        if (r < 3) {
+            char s[4];
+            size_t n = 1 + rand() % 4;
+            for (size_t i = 0; i < n; i++) s[i] = rand() % 3 ? 'a' + rand() % 26 : '\n';
+            gap_move(&g, pos);
+            if (n == 1) gap_insert(&g, s[0]);
+            else gap_insert_n(&g, s, n);
+            model_insert(pos, s, n);
+        } else if (r < 4) {
+            gap_move(&g, pos);
+            CHECK(gap_backspace(&g) == (pos > 0));
+            if (pos > 0) model_delete(pos - 1, 1);
+        } else if (r < 5) {
+            gap_move(&g, pos);
+            CHECK(gap_delete(&g) == (pos < model_len));
+            if (pos < model_len) model_delete(pos, 1);
+        } else if (r < 6) {
+            size_t n = rand() % 8;
+            if (pos + n > model_len) n = model_len - pos;
+            gap_delete_range(&g, pos, pos + n);
+            model_delete(pos, n);
+        } else if (r < 7) {
+            gap_move(&g, pos);
+            CHECK(gap_cursor(&g) == pos);
+        } else if (op % 50 == 0) {
+            check_lines(&g);
+            CHECK(model_equals(&g));
+        }
+    }
+    check_lines(&g);
+    CHECK(model_equals(&g));
+    gap_free(&g);
+}
+
+int main(void) {
+    test_line_index();
+    test_random_edits();
+    model_free();
+    return TEST_RESULT();
+}
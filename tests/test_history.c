@@ -0,0 +1,247 @@
+/* test_history.c - Undo runs, transactions and the .undo sidecar */
+#define _POSIX_C_SOURCE 200809L
+
+#include "history.h"
+#include "test.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int test_failures;
+
+static int text_is(struct gapbuf *g, const char *want) {
+    size_t len = gap_length(g);
+    char *text = malloc(len + 1);
+    gap_get(g, text, len + 1);
+    int same = len == strlen(want) && memcmp(text, want, len) == 0;
+    free(text);
+    return same;
+}
+
+static size_t records(struct editHistory *h) {
+    size_t n = 0;
+    for (struct edit *e = h->first; e; e = e->next) n++;
+    return n;
+}
+
+/* Edit the buffer and record it the way the editor does */
+static void type(struct editHistory *h, struct gapbuf *g, size_t pos, const char *s) {
+    for (; *s; s++, pos++) {
+        gap_move(g, pos);
+        gap_insert(g, *s);
+        history_push(h, *s == '\n' ? EDIT_INSERT_NEWLINE : EDIT_INSERT, pos, *s);
+    }
+}
+
+static void backspace(struct editHistory *h, struct gapbuf *g, size_t pos) {
+    char ch = gap_char_at(g, pos - 1);
+    gap_move(g, pos);
+    gap_backspace(g);
+    history_push(h, EDIT_DELETE, pos - 1, ch);
+}
+
+static void delete(struct editHistory *h, struct gapbuf *g, size_t pos) {
+    char ch = gap_char_at(g, pos);
+    gap_move(g, pos);
+    gap_delete(g);
+    history_push(h, EDIT_DELETE, pos, ch);
+}
+
+static void test_runs(void) {
+    struct gapbuf g;
+    struct editHistory h;
+    gap_init(&g, 16);
+    history_init(&h);
+    gap_load(&g, "abc", 3);
+    
+    /* typing at adjacent positions extends one run */
+    type(&h, &g, 3, "def");
+    CHECK(records(&h) == 1 && h.top->len == 3);
+    type(&h, &g, 0, "x");
+    CHECK(records(&h) == 2);
+    CHECK(text_is(&g, "xabcdef"));
+    
+    /* Backspace runs backwards, Delete forwards */
+    backspace(&h, &g, 7);
+    backspace(&h, &g, 6);
+    CHECK(records(&h) == 3 && h.top->len == 2 && h.top->backward);
+    delete(&h, &g, 1);
+    delete(&h, &g, 1);
+    CHECK(records(&h) == 4 && h.top->len == 2 && !h.top->backward);
+    CHECK(text_is(&g, "xcd"));
+    
+    /* each run undoes as one unit, and redo replays it */
+    CHECK(history_undo(&h, &g));
+    CHECK(text_is(&g, "xabcd"));
+    CHECK(history_undo(&h, &g));
+    CHECK(text_is(&g, "xabcdef"));
+    CHECK(history_undo(&h, &g));
+    CHECK(text_is(&g, "abcdef"));
+    CHECK(history_redo(&h, &g));
+    CHECK(history_redo(&h, &g));
+    CHECK(text_is(&g, "xabcd"));
+    CHECK(history_undo(&h, &g) && history_undo(&h, &g) && history_undo(&h, &g));
+    CHECK(text_is(&g, "abc"));
+    CHECK(!history_undo(&h, &g));
+    
+    /* a new edit drops what was undone */
+    CHECK(history_redo(&h, &g));
+    type(&h, &g, 0, "y");
+    CHECK(records(&h) == 2);
+    CHECK(!history_redo(&h, &g));
+    CHECK(text_is(&g, "yabcdef"));
+    
+    history_free(&h);
+    gap_free(&g);
+}
+
+static void test_transactions(void) {
+    struct gapbuf g;
+    struct editHistory h;
+    gap_init(&g, 16);
+    history_init(&h);
+    gap_load(&g, "one two", 7);
+    
+    type(&h, &g, 7, "!");
+    history_begin(&h);
+    type(&h, &g, 0, "[");
+    history_begin(&h);
+    type(&h, &g, 4, "\n");
+    delete(&h, &g, 6);
+    history_end(&h);
+    type(&h, &g, 8, "]");
+    history_end(&h);
+    CHECK(text_is(&g, "[one\n wo]!"));
+    
+    /* the nested transaction undoes and redoes with the outer one */
+    CHECK(history_undo(&h, &g));
+    CHECK(text_is(&g, "one two!"));
+    CHECK(history_redo(&h, &g));
+    CHECK(text_is(&g, "[one\n wo]!"));
+    CHECK(history_undo(&h, &g) && history_undo(&h, &g));
+    CHECK(text_is(&g, "one two"));
+    
+    /* typing after a transaction does not join it */
+    CHECK(history_redo(&h, &g) && history_redo(&h, &g));
+    type(&h, &g, 10, "?");
+    CHECK(history_undo(&h, &g));
+    CHECK(text_is(&g, "[one\n wo]!"));
+    
+    history_free(&h);
+    gap_free(&g);
+}
+
+static int write_file(const char *path, const char *text) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    fputs(text, f);
+    return fclose(f);
+}
+
+/* Save the buffer to path, with its history in the sidecar. The hash
+ * stored is the saved text's, or a wrong one. */
+static void save(struct editHistory *h, struct gapbuf *g, const char *path, int wrong_hash) {
+    size_t len = gap_length(g), data_len;
+    char *text = malloc(len + 1);
+    gap_get(g, text, len + 1);
+    text[len] = '\0';
+    char *data = history_serialize(h, &data_len);
+    CHECK(write_file(path, text) == 0);
+    CHECK(history_store(h, data, data_len, gap_hash(g) ^ (wrong_hash != 0)) == 0);
+    free(data);
+    free(text);
+}
+
+/* Open path in a new session: its text, and its history attached */
+static void reopen(struct editHistory *h, struct gapbuf *g, const char *path) {
+    char text[256];
+    FILE *f = fopen(path, "r");
+    size_t len = f ? fread(text, 1, sizeof(text), f) : 0;
+    if (f) fclose(f);
+    gap_init(g, 16);
+    gap_load(g, text, len);
+    history_init(h);
+    history_attach(h, path);
+}
+
+static void test_sidecar(void) {
+    char dir[] = "/tmp/test_history.XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        test_failures++;
+        return;
+    }
+    char path[64], sidecar[64];
+    snprintf(path, sizeof(path), "%s/notes.txt", dir);
+    snprintf(sidecar, sizeof(sidecar), "%s/.notes.txt.undo", dir);
+    
+    struct gapbuf g;
+    struct editHistory h;
+    CHECK(write_file(path, "first\n") == 0);
+    reopen(&h, &g, path);
+    CHECK(!h.pending);
+    type(&h, &g, 6, "second");
+    history_begin(&h);
+    backspace(&h, &g, 5);
+    type(&h, &g, 4, "T");
+    history_end(&h);
+    save(&h, &g, path, 0);
+    history_free(&h);
+    gap_free(&g);
+    
+    /* the next session undoes into the saved history */
+    reopen(&h, &g, path);
+    CHECK(h.pending);
+    CHECK(text_is(&g, "firsT\nsecond"));
+    CHECK(history_undo(&h, &g));
+    CHECK(text_is(&g, "first\nsecond"));
+    CHECK(history_undo(&h, &g));
+    CHECK(text_is(&g, "first\n"));
+    CHECK(!history_undo(&h, &g));
+    CHECK(history_redo(&h, &g) && history_redo(&h, &g));
+    CHECK(text_is(&g, "firsT\nsecond"));
+    
+    /* saving again carries the old history forward */
+    type(&h, &g, 12, " third");
+    save(&h, &g, path, 0);
+    history_free(&h);
+    gap_free(&g);
+    reopen(&h, &g, path);
+    CHECK(history_undo(&h, &g) && history_undo(&h, &g) && history_undo(&h, &g));
+    CHECK(text_is(&g, "first\n"));
+    history_free(&h);
+    gap_free(&g);
+    
+    /* a sidecar whose hash does not match the text is not applied */
+    reopen(&h, &g, path);
+    type(&h, &g, 0, ">");
+    save(&h, &g, path, 1);
+    history_free(&h);
+    gap_free(&g);
+    reopen(&h, &g, path);
+    CHECK(h.pending);
+    CHECK(!history_undo(&h, &g));
+    CHECK(!h.pending);
+    CHECK(text_is(&g, ">firsT\nsecond third"));
+    history_free(&h);
+    gap_free(&g);
+    
+    /* nor one for a file that changed size since */
+    CHECK(write_file(path, "changed\n") == 0);
+    reopen(&h, &g, path);
+    CHECK(!h.pending);
+    CHECK(!history_undo(&h, &g));
+    history_free(&h);
+    gap_free(&g);
+    
+    unlink(sidecar);
+    unlink(path);
+    rmdir(dir);
+}
+
+int main(void) {
+    test_runs();
+    test_transactions();
+    test_sidecar();
+    return TEST_RESULT();
+}
@@ -0,0 +1,142 @@
+/* test_piece.c - Piece table edits and line queries against a string model */
+#define _POSIX_C_SOURCE 200809L
+
+#include "piece.h"
+#include "test.h"
+#include "model.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+int test_failures;
+
+/* Every node outranks its children and its totals add up; returns the
+ * subtree's length */
+static size_t check_tree(struct piece *t) {
+    if (!t) return 0;
+    CHECK(!t->left || t->left->prio <= t->prio);
+    CHECK(!t->right || t->right->prio <= t->prio);
+    CHECK(t->len > 0);
+    size_t len = check_tree(t->left) + t->len + check_tree(t->right);
+    CHECK(t->sum_len == len);
+    return len;
+}
+
+static void check_text(struct piecetable *pt) {
+    CHECK(check_tree(pt->root) == model_len);
+    size_t pos = 0, n;
+    while (pos < model_len) {
+        const char *s = pt_span(pt, pos, &n);
+        CHECK(n > 0 && pos + n <= model_len && memcmp(s, model + pos, n) == 0);
+        if (n == 0) break;
+        pos += n;
+    }
+}
+
+/* A file of len bytes, mapped the way the editor opens one so pt_free
+ * can unmap it */
+static char *make_original(size_t len, int line_len) {
+    char *text = malloc(len + 1);
+    for (size_t i = 0; i < len; i++) {
+        text[i] = rand() % line_len == 0 ? '\n' : 'a' + rand() % 26;
+    }
+    model_set(text, len);
+    free(text);
+    
+    if (len == 0) return NULL;
+    char path[] = "/tmp/test_piece.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        perror("mkstemp");
+        exit(1);
+    }
+    unlink(path);
+    char *map = NULL;
+    if (write(fd, model, len) != (ssize_t)len ||
+        (map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        perror("test file");
+        exit(1);
+    }
+    close(fd);
+    return map;
+}
+
+static void wait_for_index(struct piecetable *pt) {
+    struct timespec ts = { 0, 1000000 };
+    size_t count;
+    while (!pt_line_count_ready(pt, &count)) nanosleep(&ts, NULL);
+    CHECK(count == model_lines());
+}
+
+/* Random edits and line queries spread over a document several index
+ * chunks long, with or without the index built first */
+static void test_random_edits(size_t len, int line_len, int indexed) {
+    char *map = make_original(len, line_len);
+    struct piecetable *pt = pt_open(map, len);
+    CHECK(pt->root && !pt->root->left && !pt->root->right);
+    if (indexed) wait_for_index(pt);
+    
+    for (int op = 0; op < 1500; op++) {
+        size_t pos = rand() % (model_len + 1);
+        int r = rand() % 10;
+        if (r < 3) {
+            char s[6];
+            size_t n = 1 + rand() % 6;
+            for (size_t i = 0; i < n; i++) s[i] = rand() % 3 ? 'x' : '\n';
+            if (n == 1) pt_insert(pt, pos, s[0]);
+            else pt_insert_n(pt, pos, s, n);
+            model_insert(pos, s, n);
+        } else if (r < 5 && pos < model_len) {
+            size_t n = rand() % 4 ? 1 + rand() % 16 : 1 + rand() % 200000;
+            if (pos + n > model_len) n = model_len - pos;
+            if (n == 1) pt_delete(pt, pos);
+            else pt_delete_range(pt, pos, n);
+            model_delete(pos, n);
+        } else if (r < 6) {
+            size_t limit = 1 + rand() % 4000, lines = model_lines();
+            CHECK(pt_lines_upto(pt, limit) == (lines < limit ? lines : limit));
+        } else if (r < 8) {
+            size_t row = rand() % (r < 7 ? 4000 : model_lines() + 1);
+            CHECK(pt_line_start(pt, row) == model_line_start(row));
+        } else if (r < 9) {
+            CHECK(pt_line_of(pt, pos) == model_line_of(pos));
+            if (pos < model_len) CHECK(pt_char_at(pt, pos) == model[pos]);
+        } else {
+            size_t count;
+            if (pt_line_count_ready(pt, &count)) CHECK(count == model_lines());
+        }
+    }
+    CHECK(pt_line_count(pt) == model_lines());
+    check_text(pt);
+    pt_free(pt);
+}
+
+static void test_empty(void) {
+    char *map = make_original(0, 1);
+    struct piecetable *pt = pt_open(map, 0);
+    CHECK(pt_line_count(pt) == 1);
+    pt_insert_n(pt, 0, "a\nb", 3);
+    model_insert(0, "a\nb", 3);
+    CHECK(pt_line_count(pt) == 2);
+    CHECK(pt_line_start(pt, 1) == 2);
+    CHECK(pt_line_end(pt, 0) == 1);
+    pt_delete_range(pt, 0, 3);
+    model_delete(0, 3);
+    CHECK(pt_line_count(pt) == 1);
+    check_text(pt);
+    pt_free(pt);
+}
+
+int main(void) {
+    srand(7);
+    test_empty();
+    test_random_edits(1000, 10, 0);
+    test_random_edits(900000, 40, 0);
+    test_random_edits(900000, 40, 1);
+    test_random_edits(700000, 5000, 1);
+    test_random_edits(400000, 2, 1);
+    model_free();
+    return TEST_RESULT();
+}
@@ -0,0 +1,191 @@
+/* test_regex.c - Regex search: match choice, anchors, the gap, DFA flushes */
+#include "regex.h"
+#include "buffer.h"
+#include "test.h"
+#include <stdlib.h>
+#include <string.h>
+
+int test_failures;
+
+/* Search text for pattern from every gap position, forward or backward
+ * over [start, end); returns 1 if each finds [want, want_end) */
+static int finds_in(const char *pattern, const char *text, size_t len, int dir,
+                    size_t start, size_t end, size_t want, size_t want_end) {
+    const char *error;
+    struct regex *re = regex_compile(pattern, strlen(pattern), &error);
+    if (!re) return 0;
+    struct gapbuf g;
+    gap_init(&g, 16);
+    gap_load(&g, text, len);
+    
+    int ok = 1;
+    for (size_t gap = 0; gap <= len && ok; gap++) {
+        size_t mend = SEARCH_NONE;
+        gap_move(&g, gap);
+        size_t hit = dir > 0 ? regex_search(re, &g, start, end, &mend)
+                             : regex_search_backward(re, &g, start, end, &mend);
+        ok = hit == want && (want == SEARCH_NONE || mend == want_end);
+    }
+    gap_free(&g);
+    regex_free(re);
+    return ok;
+}
+
+static int finds(const char *pattern, const char *text, size_t want, size_t want_end) {
+    size_t len = strlen(text);
+    return finds_in(pattern, text, len, 1, 0, len, want, want_end);
+}
+
+static int finds_last(const char *pattern, const char *text, size_t want, size_t want_end) {
+    size_t len = strlen(text);
+    return finds_in(pattern, text, len, -1, 0, len, want, want_end);
+}
+
+static const char *compile_error(const char *pattern) {
+    const char *error = NULL;
+    struct regex *re = regex_compile(pattern, strlen(pattern), &error);
+    regex_free(re);
+    return re ? NULL : error;
+}
+
+/* -------- which match -------- */
+static void test_leftmost_first(void) {
+    /* the leftmost match, then the alternative written first */
+    CHECK(finds("a|ab", "xab", 1, 2));
+    CHECK(finds("ab|a", "xab", 1, 3));
+    CHECK(finds("(a|ab)(c|bcd)", "abcd", 0, 4));
+    CHECK(finds("b|ab", "xab", 1, 3));
+    CHECK(finds("a.*b", "axbyb", 0, 5));
+    CHECK(finds("zz", "abc", SEARCH_NONE, 0));
+}
+
+static void test_lazy(void) {
+    CHECK(finds("a+?", "aaa", 0, 1));
+    CHECK(finds("a*?", "baa", 0, 0));
+    CHECK(finds("a.*?b", "axbyb", 0, 3));
+    CHECK(finds("a{2,3}?", "aaaa", 0, 2));
+    CHECK(finds("a{2,3}", "aaaa", 0, 3));
+    CHECK(finds("(ab)+?c", "ababc", 0, 5));
+}
+
+static void test_anchors(void) {
+    CHECK(finds("b*$", "abb\nc", 1, 3));
+    CHECK(finds("^c", "abb\nc", 4, 5));
+    CHECK(finds("$", "ab\ncd", 2, 2));
+    CHECK(finds("^$", "a\n\nb", 2, 2));
+    CHECK(finds("^b", "ab\nb", 3, 4));
+    CHECK(finds("a$", "ab\nxa", 4, 5));
+    /* . stops at a newline */
+    CHECK(finds("a.b", "a\nb axb", 4, 7));
+}
+
+static void test_classes(void) {
+    CHECK(finds("\\d+", "ab12c", 2, 4));
+    CHECK(finds("\\w+", "  a_1 ", 2, 5));
+    CHECK(finds("\\S+", " \t xy ", 3, 5));
+    CHECK(finds("[^a-c]", "abcd", 3, 4));
+    CHECK(finds("[\\d.]+", "v1.2", 1, 4));
+    CHECK(finds("x\\n", "ax\n", 1, 3));
+    CHECK(finds("\\.", "a.b", 1, 2));
+    CHECK(finds("a{,2}", "a{,2}", 0, 5));
+}
+
+static void test_escapes(void) {
+    CHECK(compile_error("\\d\\D\\w\\W\\s\\S\\n\\t\\r\\f\\v\\0") == NULL);
+    CHECK(compile_error("\\.\\*\\(\\[\\\\\\{\\$") == NULL);
+    CHECK(compile_error("\\q") && strcmp(compile_error("\\q"), "unsupported escape") == 0);
+    CHECK(compile_error("a\\b") && strcmp(compile_error("a\\b"), "unsupported escape") == 0);
+    CHECK(compile_error("\\x41") != NULL);
+    CHECK(compile_error("[\\q]") != NULL);
+    CHECK(compile_error("[a-\\z]") != NULL);
+    CHECK(compile_error("a\\") && strcmp(compile_error("a\\"), "trailing \\") == 0);
+    CHECK(compile_error("(a") != NULL);
+    CHECK(compile_error("*a") != NULL);
+}
+
+/* -------- backward -------- */
+static void test_backward(void) {
+    /* the match starting last, then the one the pattern prefers there */
+    CHECK(finds_last("a|ab", "xab ab", 4, 5));
+    CHECK(finds_last("ab|a", "xab ab", 4, 6));
+    CHECK(finds_last("a+", "aa baa", 5, 6));
+    CHECK(finds_last("^.", "ab\ncd", 3, 4));
+    CHECK(finds_last("b*$", "abb\nc", 5, 5));
+    CHECK(finds_last("zz", "abc", SEARCH_NONE, 0));
+}
+
+static void test_range(void) {
+    const char *text = "ab ab ab";
+    CHECK(finds_in("ab", text, 8, 1, 1, 8, 3, 5));
+    CHECK(finds_in("ab", text, 8, 1, 4, 8, 6, 8));
+    CHECK(finds_in("ab", text, 8, 1, 0, 1, SEARCH_NONE, 0));
+    CHECK(finds_in("ab", text, 8, -1, 0, 5, 3, 5));
+    CHECK(finds_in("ab", text, 8, -1, 0, 4, 0, 2));
+    /* anchors look past the ends of the range at the text around it */
+    CHECK(finds_in("^b", "ab\nb", 4, 1, 1, 4, 3, 4));
+    CHECK(finds_in("^b", "ab\nb", 4, 1, 3, 4, 3, 4));
+    CHECK(finds_in("a$", "aab\n", 4, 1, 0, 2, SEARCH_NONE, 0));
+    CHECK(finds_in("b$", "aab\n", 4, 1, 0, 3, 2, 3));
+}
+
+/* -------- DFA cache -------- */
+/* a[ab]{12}c remembers which of the last 13 bytes were a: thousands of
+ * states over random a and b, more than the cache holds, so it is
+ * flushed and rebuilt mid-scan */
+static void test_cache_flush(void) {
+    size_t len = 100000;
+    char *text = malloc(len);
+    unsigned seed = 12345;
+    for (size_t i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        text[i] = (seed >> 16) & 1 ? 'a' : 'b';
+    }
+    
+    /* forward: the one c, near the end */
+    size_t c = len - 10, want = c - 13;
+    text[c] = 'c';
+    text[want] = 'a';
+    const char *error;
+    struct regex *re = regex_compile("a[ab]{12}c", 10, &error);
+    struct gapbuf g;
+    gap_init(&g, 16);
+    gap_load(&g, text, len);
+    size_t gaps[] = { 0, len / 2, want + 5, len };
+    for (size_t i = 0; i < sizeof(gaps) / sizeof(gaps[0]); i++) {
+        size_t mend = 0;
+        gap_move(&g, gaps[i]);
+        CHECK(regex_search(re, &g, 0, len, &mend) == want && mend == c + 1);
+        CHECK(regex_search(re, &g, want + 1, len, &mend) == SEARCH_NONE);
+    }
+    regex_free(re);
+    gap_free(&g);
+    
+    /* backward: the one c, near the start */
+    text[c] = 'a';
+    c = 10;
+    text[c] = 'c';
+    text[c + 13] = 'a';
+    re = regex_compile("c[ab]{12}a", 10, &error);
+    gap_init(&g, 16);
+    gap_load(&g, text, len);
+    for (size_t i = 0; i < sizeof(gaps) / sizeof(gaps[0]); i++) {
+        size_t mend = 0;
+        gap_move(&g, gaps[i] == want + 5 ? c + 5 : gaps[i]);
+        CHECK(regex_search_backward(re, &g, 0, len, &mend) == c && mend == c + 14);
+    }
+    regex_free(re);
+    gap_free(&g);
+    free(text);
+}
+
+int main(void) {
+    test_leftmost_first();
+    test_lazy();
+    test_anchors();
+    test_classes();
+    test_escapes();
+    test_backward();
+    test_range();
+    test_cache_flush();
+    return TEST_RESULT();
+}
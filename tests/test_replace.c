@@ -0,0 +1,194 @@
+/* test_replace.c - Replace-all through the editor, undone and redone */
+#define _POSIX_C_SOURCE 200809L
+
+#include "dira.h"
+#include "model.h"
+#include "test.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int test_failures;
+
+static char dir[] = "/tmp/test_replace.XXXXXX";
+static char path[64];
+
+/* -------- the model's replace-all -------- */
+/* Length of a match of the test's patterns at pos, or -1 for none */
+static long match_literal(const char *query, size_t pos) {
+    size_t n = strlen(query);
+    return pos + n <= model_len && memcmp(model + pos, query, n) == 0 ? (long)n : -1;
+}
+
+static long match_pattern(const char *query, size_t pos) {
+    if (strcmp(query, "x*") == 0) {
+        size_t end = pos;
+        while (end < model_len && model[end] == 'x') end++;
+        return (long)(end - pos);
+    }
+    if (strcmp(query, "^") == 0) {
+        return pos == 0 || model[pos - 1] == '\n' ? 0 : -1;
+    }
+    return match_literal(query, pos);
+}
+
+/* Replace the leftmost match and carry on after it, stepping one byte
+ * past an empty one */
+static void model_replace_all(const char *query, int regex, const char *with) {
+    size_t cap = 16, n = 0, *at = malloc(cap * sizeof(size_t)), *len = malloc(cap * sizeof(size_t));
+    for (size_t pos = 0; pos <= model_len; pos++) {
+        long m = regex ? match_pattern(query, pos) : match_literal(query, pos);
+        if (m < 0) continue;
+        if (n == cap) {
+            cap *= 2;
+            at = realloc(at, cap * sizeof(size_t));
+            len = realloc(len, cap * sizeof(size_t));
+        }
+        at[n] = pos;
+        len[n++] = (size_t)m;
+        if (m > 0) pos += (size_t)m - 1;
+    }
+    while (n-- > 0) {
+        model_delete(at[n], len[n]);
+        model_insert(at[n], with, strlen(with));
+    }
+    free(at);
+    free(len);
+}
+
+/* -------- driving the editor -------- */
+static void keys(const char *s) {
+    for (; *s; s++) editorProcessKey((unsigned char)*s);
+}
+
+static void open_text(const char *text, size_t len) {
+    FILE *fp = fopen(path, "wb");
+    fwrite(text, 1, len, fp);
+    fclose(fp);
+    model_set(text, len);
+    editorInit(24, 80);
+    editorOpen(path);
+}
+
+static void replace_all(const char *query, int regex, const char *with) {
+    keys("\x06");
+    if (regex) keys("\x12");
+    keys(query);
+    keys("\t");
+    keys(with);
+    keys("\r");
+    model_replace_all(query, regex, with);
+}
+
+/* Save, wait for the writer and compare the file with the model */
+static int saved_matches_model(void) {
+    keys("\x13");
+    keys("\x11");
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return 0;
+    char *text = malloc(model_len + 1);
+    size_t len = fread(text, 1, model_len + 1, fp);
+    fclose(fp);
+    int same = len == model_len && memcmp(text, model, len) == 0;
+    free(text);
+    return same;
+}
+
+/* Replace all, then check that undo brings back the text from before
+ * and redo the text after, all in one step each */
+static void check_replace(const char *text, const char *query, int regex, const char *with) {
+    open_text(text, strlen(text));
+    replace_all(query, regex, with);
+    CHECK(saved_matches_model());
+    
+    char *after = malloc(model_len + 1);
+    size_t after_len = model_len;
+    memcpy(after, model, model_len);
+    keys("\x1a");
+    model_set(text, strlen(text));
+    CHECK(saved_matches_model());
+    keys("\x19");
+    model_set(after, after_len);
+    CHECK(saved_matches_model());
+    free(after);
+    editorFree();
+}
+
+static void test_literal(void) {
+    check_replace("ab cab abab\nab", "ab", 0, "XYZW");
+    check_replace("ab cab abab\nab", "ab", 0, "");
+    check_replace("aaaa", "aa", 0, "b");
+    check_replace("no match here", "zz", 0, "q");
+}
+
+static void test_empty_matches(void) {
+    check_replace("axxb\nxx\n", "x*", 1, "-");
+    check_replace("", "x*", 1, "-");
+    check_replace("one\ntwo\n\nthree", "^", 1, "> ");
+}
+
+/* Many matches over a document far larger than the gap, growing it */
+static void test_large(void) {
+    size_t n = 3000, len = n * 6;
+    char *text = malloc(len + 1);
+    for (size_t i = 0; i < n; i++) memcpy(text + i * 6, i % 7 ? "ab cd " : "ab\ncd ", 6);
+    text[len] = '\0';
+    check_replace(text, "cd", 0, "<longer>");
+    check_replace(text, "x*", 1, "");
+    free(text);
+}
+
+/* An edit first leaves the gap mid-buffer; replace-all and typing undo
+ * separately */
+static void test_after_edit(void) {
+    const char *text = "ab\nab\nab\n";
+    open_text(text, strlen(text));
+    editorProcessKey(ARROW_DOWN);
+    keys("q");
+    model_insert(model_line_start(1), "q", 1);
+    char *typed = malloc(model_len);
+    size_t typed_len = model_len;
+    memcpy(typed, model, model_len);
+    
+    replace_all("ab", 0, "abab");
+    CHECK(saved_matches_model());
+    keys("\x1a");
+    model_set(typed, typed_len);
+    CHECK(saved_matches_model());
+    keys("\x1a");
+    model_set(text, strlen(text));
+    CHECK(saved_matches_model());
+    keys("\x19\x19");
+    model_set(typed, typed_len);
+    model_replace_all("ab", 0, "abab");
+    CHECK(saved_matches_model());
+    free(typed);
+    editorFree();
+}
+
+int main(void) {
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(path, sizeof(path), "%s/doc.txt", dir);
+    setenv("DIRA_CONFIG", "/nonexistent/dira.conf", 1);
+    int null = open("/dev/null", O_WRONLY);
+    editorSetOutput(null);
+    
+    test_literal();
+    test_empty_matches();
+    test_large();
+    test_after_edit();
+    
+    char sidecar[64];
+    snprintf(sidecar, sizeof(sidecar), "%s/.doc.txt.undo", dir);
+    unlink(sidecar);
+    unlink(path);
+    rmdir(dir);
+    close(null);
+    model_free();
+    return TEST_RESULT();
+}
@@ -0,0 +1,144 @@
+/* test_search.c - Literal search across the gap, forward and backward */
+#include "search.h"
+#include "buffer.h"
+#include "model.h"
+#include "test.h"
+#include <stdlib.h>
+#include <string.h>
+
+int test_failures;
+
+/* -------- the model's search -------- */
+static size_t model_forward(const char *q, size_t n, size_t start, size_t end) {
+    for (size_t i = start; i + n <= end; i++) {
+        if (memcmp(model + i, q, n) == 0) return i;
+    }
+    return SEARCH_NONE;
+}
+
+static size_t model_backward(const char *q, size_t n, size_t start, size_t end) {
+    for (size_t i = end; i-- > start; ) {
+        if (i + n <= end && memcmp(model + i, q, n) == 0) return i;
+    }
+    return SEARCH_NONE;
+}
+
+/* Search the model's text for q over every range with the gap at every
+ * position, both ways; returns 1 if each agrees with the model */
+static int agrees(const char *q) {
+    size_t n = strlen(q);
+    struct searchPattern p;
+    struct gapbuf g;
+    search_compile(&p, q, n);
+    gap_init(&g, 16);
+    gap_load(&g, model, model_len);
+    
+    int ok = 1;
+    for (size_t gap = 0; gap <= model_len && ok; gap++) {
+        gap_move(&g, gap);
+        for (size_t start = 0; start <= model_len && ok; start++) {
+            for (size_t end = start; end <= model_len && ok; end++) {
+                ok = search_forward(&p, &g, start, end) == model_forward(q, n, start, end) &&
+                     search_backward(&p, &g, start, end) == model_backward(q, n, start, end);
+            }
+        }
+    }
+    gap_free(&g);
+    search_free(&p);
+    return ok;
+}
+
+static void test_small(void) {
+    const char *text = "abaabab\nxaaab ab";
+    model_set(text, strlen(text));
+    CHECK(agrees("a"));
+    CHECK(agrees("ab"));
+    CHECK(agrees("aa"));
+    CHECK(agrees("aab"));
+    CHECK(agrees("bab\nx"));
+    CHECK(agrees("ab ab"));
+    CHECK(agrees("abaabab\nxaaab ab"));
+    CHECK(agrees("zz"));
+    CHECK(agrees("abaabab\nxaaab abc"));
+}
+
+/* The gap splitting one known match at each of its bytes */
+static void test_gap_in_match(void) {
+    const char *text = "one two three two one";
+    const char *q = "three";
+    size_t at = 8, n = 5, len = strlen(text);
+    struct searchPattern p;
+    struct gapbuf g;
+    search_compile(&p, q, n);
+    gap_init(&g, 16);
+    gap_load(&g, text, len);
+    for (size_t gap = at + 1; gap < at + n; gap++) {
+        gap_move(&g, gap);
+        CHECK(search_forward(&p, &g, 0, len) == at);
+        CHECK(search_forward(&p, &g, at, at + n) == at);
+        CHECK(search_forward(&p, &g, at + 1, len) == SEARCH_NONE);
+        CHECK(search_backward(&p, &g, 0, len) == at);
+        CHECK(search_backward(&p, &g, at, at + n) == at);
+        CHECK(search_backward(&p, &g, 0, at + n - 1) == SEARCH_NONE);
+    }
+    gap_free(&g);
+    search_free(&p);
+}
+
+/* Long text over a small alphabet, so the skip tables and memchr see
+ * many near misses on both sides of the gap */
+static void test_random(void) {
+    size_t len = 20000;
+    char *text = malloc(len);
+    for (size_t i = 0; i < len; i++) text[i] = "abc"[rand() % 3];
+    model_set(text, len);
+    free(text);
+    
+    const char *queries[] = { "abcab", "cccc", "abacabac", "b" };
+    struct gapbuf g;
+    gap_init(&g, 16);
+    gap_load(&g, model, model_len);
+    for (size_t k = 0; k < sizeof(queries) / sizeof(queries[0]); k++) {
+        const char *q = queries[k];
+        size_t n = strlen(q);
+        struct searchPattern p;
+        search_compile(&p, q, n);
+        for (int i = 0; i < 200; i++) {
+            size_t start = rand() % len, end = start + rand() % (len - start + 1);
+            gap_move(&g, start + rand() % (end - start + 1));
+            CHECK(search_forward(&p, &g, start, end) == model_forward(q, n, start, end));
+            CHECK(search_backward(&p, &g, start, end) == model_backward(q, n, start, end));
+        }
+        search_free(&p);
+    }
+    gap_free(&g);
+}
+
+static void test_bytes(void) {
+    struct searchPattern p;
+    search_compile(&p, "lo w", 4);
+    CHECK(search_bytes(&p, "hello world", 11) == 3);
+    CHECK(search_bytes(&p, "hello", 5) == SEARCH_NONE);
+    search_free(&p);
+    
+    /* an empty query finds nothing */
+    struct gapbuf g;
+    gap_init(&g, 16);
+    gap_load(&g, "abc", 3);
+    search_compile(&p, NULL, 0);
+    CHECK(search_forward(&p, &g, 0, 3) == SEARCH_NONE);
+    CHECK(search_backward(&p, &g, 0, 3) == SEARCH_NONE);
+    CHECK(search_bytes(&p, "abc", 3) == SEARCH_NONE);
+    search_free(&p);
+    gap_free(&g);
+}
+
+int main(void) {
+    srand(1);
+    test_small();
+    test_gap_in_match();
+    test_random();
+    test_bytes();
+    model_free();
+    return TEST_RESULT();
+}